@@ -5,15 +5,25 @@
 #include <string>
 #include <filesystem>
 #include <fstream>
+#include <algorithm>
 #include <stdarg.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <linux/vfio.h>
 #include "PciDevice.h"
 using namespace std;
+namespace fs = std::filesystem;
 
 const char* c(const string& s) {return s.c_str();}
 
+// The highest BAR number a device can have, and the resource flag of a BAR in I/O-port space
+static const int      MAX_BAR       = 5;
+static const uint64_t IORESOURCE_IO = 0x100;
+
 
 //=================================================================================================
 // FileDes - This is a standard Unix/Linux file descriptor that closes itself
@@ -145,10 +155,298 @@ void PciDevice::close()
 
     // Delete the list of memory-mapped resources
     resource_.clear();
+
+    // Stop the device's interrupts from being delivered to us
+    if (vfioDevice_ >= 0 && vfioIrqIndex_ >= 0)
+    {
+        vfio_irq_set irq_set = {};
+        irq_set.argsz = sizeof(irq_set);
+        irq_set.flags = VFIO_IRQ_SET_DATA_NONE | VFIO_IRQ_SET_ACTION_TRIGGER;
+        irq_set.index = vfioIrqIndex_;
+        ioctl(vfioDevice_, VFIO_DEVICE_SET_IRQS, &irq_set);
+    }
+    vfioIrqIndex_ = -1;
+    uioIrqCount_  = 0;
+
+    // Close whichever file descriptors we have open
+    for (int* fd : {&irqFd_, &vfioDevice_, &vfioGroup_, &vfioContainer_})
+    {
+        if (*fd >= 0) ::close(*fd);
+        *fd = -1;
+    }
+}
+//=================================================================================================
+
+
+
+//=================================================================================================
+// mapVfioResources() - Maps each memory-mappable resource through the VFIO device file of a
+//                      device that's bound to vfio-pci
+//
+// Passed: deviceDir = The device's sysfs directory
+//=================================================================================================
+void PciDevice::mapVfioResources(string deviceDir)
+{
+    // The device's IOMMU group is the name of the directory its "iommu_group" link points to
+    error_code ec;
+    string group = fs::read_symlink(deviceDir + "/iommu_group", ec).filename().string();
+    if (ec) throwRuntime("%s has no IOMMU group", c(deviceDir));
+
+    // Open a VFIO container, and make sure we speak the same language
+    vfioContainer_ = ::open("/dev/vfio/vfio", O_RDWR);
+    if (vfioContainer_ < 0) throwRuntime("Can't open /dev/vfio/vfio");
+    if (ioctl(vfioContainer_, VFIO_GET_API_VERSION) != VFIO_API_VERSION)
+    {
+        throwRuntime("Unknown VFIO API version");
+    }
+
+    // Open the group, and make sure every device in it is bound to VFIO
+    string filename = "/dev/vfio/" + group;
+    vfioGroup_ = ::open(c(filename), O_RDWR);
+    if (vfioGroup_ < 0) throwRuntime("Can't open %s", c(filename));
+
+    vfio_group_status status = {};
+    status.argsz = sizeof(status);
+    ioctl(vfioGroup_, VFIO_GROUP_GET_STATUS, &status);
+    if (!(status.flags & VFIO_GROUP_FLAGS_VIABLE))
+    {
+        throwRuntime("IOMMU group %s isn't viable (are all of its devices bound to vfio-pci?)", c(group));
+    }
+
+    // Put the group into the container, and fetch the device from it
+    if (ioctl(vfioGroup_, VFIO_GROUP_SET_CONTAINER, &vfioContainer_) < 0
+    ||  ioctl(vfioContainer_, VFIO_SET_IOMMU, VFIO_TYPE1_IOMMU) < 0)
+    {
+        throwRuntime("Can't attach IOMMU group %s to a VFIO container", c(group));
+    }
+    vfioDevice_ = ioctl(vfioGroup_, VFIO_GROUP_GET_DEVICE_FD, c(bdf_));
+    if (vfioDevice_ < 0) throwRuntime("Can't fetch VFIO device %s", c(bdf_));
+
+    // Each BAR is a region of the device file
+    for (auto& bar : resource_)
+    {
+        vfio_region_info region = {};
+        region.argsz = sizeof(region);
+        region.index = VFIO_PCI_BAR0_REGION_INDEX + bar.bar;
+        if (ioctl(vfioDevice_, VFIO_DEVICE_GET_REGION_INFO, &region) < 0)
+        {
+            throwRuntime("Can't fetch region info for BAR %i of %s", bar.bar, c(bdf_));
+        }
+
+        // A region VFIO won't let us map is left unmapped, and dropped from the list below
+        if (!(region.flags & VFIO_REGION_INFO_FLAG_MMAP)) continue;
+
+        void* ptr = ::mmap(0, region.size, PROT_READ | PROT_WRITE, MAP_SHARED, vfioDevice_, region.offset);
+        if (ptr == MAP_FAILED) throwRuntime("mmap failed on BAR %i of %s", bar.bar, c(bdf_));
+
+        bar.baseAddr = (uint8_t*)ptr;
+        bar.size     = region.size;
+    }
+
+    // Keep only the BARs that we mapped
+    auto unmapped = [](const resource_t& bar) {return bar.baseAddr == nullptr;};
+    resource_.erase(remove_if(resource_.begin(), resource_.end(), unmapped), resource_.end());
+    if (resource_.empty()) throwRuntime("None of the BARs of %s can be memory-mapped through VFIO", c(bdf_));
 }
 //=================================================================================================
 
 
+//=================================================================================================
+// mapSysfsResources() - Maps each memory-mappable resource through the device's sysfs
+//                       "resource<n>" files, which doesn't need /dev/mem
+//
+// Passed: deviceDir = The device's sysfs directory
+//=================================================================================================
+void PciDevice::mapSysfsResources(string deviceDir)
+{
+    for (auto& bar : resource_)
+    {
+        string filename = deviceDir + "/resource" + to_string(bar.bar);
+
+        FileDes fd = ::open(c(filename), O_RDWR | O_SYNC);
+        if (fd < 0) throwRuntime("Can't open %s", c(filename));
+
+        void* ptr = ::mmap(0, bar.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) throwRuntime("mmap failed on %s for size 0x%lx", c(filename), bar.size);
+
+        bar.baseAddr = (uint8_t*)ptr;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// setupVfioInterrupts() - Arranges for the device's interrupts to be signalled through an
+//                         eventfd.  MSI is used if the device has it, and INTx otherwise
+//=================================================================================================
+void PciDevice::setupVfioInterrupts()
+{
+    for (int index : {VFIO_PCI_MSI_IRQ_INDEX, VFIO_PCI_INTX_IRQ_INDEX})
+    {
+        // Find out whether the device has this kind of interrupt
+        vfio_irq_info info = {};
+        info.argsz = sizeof(info);
+        info.index = index;
+        if (ioctl(vfioDevice_, VFIO_DEVICE_GET_IRQ_INFO, &info) < 0) continue;
+        if (info.count == 0 || !(info.flags & VFIO_IRQ_INFO_EVENTFD)) continue;
+
+        // Point the first interrupt of that kind at an eventfd
+        int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efd < 0) return;
+
+        char buffer[sizeof(vfio_irq_set) + sizeof(int)] = {};
+        auto irq_set   = (vfio_irq_set*)buffer;
+        irq_set->argsz = sizeof(buffer);
+        irq_set->flags = VFIO_IRQ_SET_DATA_EVENTFD | VFIO_IRQ_SET_ACTION_TRIGGER;
+        irq_set->index = index;
+        irq_set->start = 0;
+        irq_set->count = 1;
+        memcpy(irq_set->data, &efd, sizeof(int));
+
+        if (ioctl(vfioDevice_, VFIO_DEVICE_SET_IRQS, irq_set) < 0)
+        {
+            ::close(efd);
+            continue;
+        }
+
+        irqFd_        = efd;
+        vfioIrqIndex_ = index;
+        return;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// setupUioInterrupts() - If the device is bound to a UIO driver, opens its /dev/uio<n>, which
+//                        is readable when the device raises an interrupt
+//
+// Passed: deviceDir = The device's sysfs directory
+//=================================================================================================
+void PciDevice::setupUioInterrupts(string deviceDir)
+{
+    error_code ec;
+    for (auto const& entry : fs::directory_iterator(deviceDir + "/uio", ec))
+    {
+        string filename = "/dev/" + entry.path().filename().string();
+        irqFd_ = ::open(c(filename), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (irqFd_ < 0) return;
+        unmaskInterrupt();
+        return;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// unmaskInterrupt() - Re-enables the device's interrupt.  MSI and eventfd-based interrupts
+//                     don't need it, but INTx and UIO interrupts are masked once delivered
+//=================================================================================================
+void PciDevice::unmaskInterrupt()
+{
+    if (access_ == ACCESS_UIO)
+    {
+        int32_t enable = 1;
+        if (::write(irqFd_, &enable, sizeof(enable)) < 0) {}
+    }
+
+    if (access_ == ACCESS_VFIO && vfioIrqIndex_ == VFIO_PCI_INTX_IRQ_INDEX)
+    {
+        vfio_irq_set irq_set = {};
+        irq_set.argsz = sizeof(irq_set);
+        irq_set.flags = VFIO_IRQ_SET_DATA_NONE | VFIO_IRQ_SET_ACTION_UNMASK;
+        irq_set.index = vfioIrqIndex_;
+        irq_set.start = 0;
+        irq_set.count = 1;
+        ioctl(vfioDevice_, VFIO_DEVICE_SET_IRQS, &irq_set);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// acknowledgeInterrupt() - Consumes the interrupts that have been delivered, and re-enables
+//                          the device's interrupt
+//
+// Returns: The number of interrupts consumed, 0 if none were pending
+//=================================================================================================
+uint32_t PciDevice::acknowledgeInterrupt()
+{
+    uint32_t result = 0;
+    if (irqFd_ < 0) return 0;
+
+    // An eventfd holds the number of interrupts since it was last read
+    if (access_ == ACCESS_VFIO)
+    {
+        uint64_t count;
+        if (::read(irqFd_, &count, sizeof(count)) == sizeof(count)) result = count;
+    }
+
+    // /dev/uio<n> holds the total number of interrupts so far
+    if (access_ == ACCESS_UIO)
+    {
+        uint32_t total;
+        if (::read(irqFd_, &total, sizeof(total)) == sizeof(total))
+        {
+            result = total - uioIrqCount_;
+            uioIrqCount_ = total;
+        }
+    }
+
+    if (result) unmaskInterrupt();
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parseAccess() - Converts the name of an access method to an access_t
+//=================================================================================================
+PciDevice::access_t PciDevice::parseAccess(string name)
+{
+    if (name == "auto"  ) return ACCESS_AUTO;
+    if (name == "devmem") return ACCESS_DEVMEM;
+    if (name == "vfio"  ) return ACCESS_VFIO;
+    if (name == "uio"   ) return ACCESS_UIO;
+    throwRuntime("Unknown device access method '%s'", c(name));
+    return ACCESS_AUTO;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// accessName() - Converts an access_t to the name of the access method
+//=================================================================================================
+const char* PciDevice::accessName(access_t access)
+{
+    switch (access)
+    {
+        case ACCESS_DEVMEM: return "devmem";
+        case ACCESS_VFIO:   return "vfio";
+        case ACCESS_UIO:    return "uio";
+        default:            return "auto";
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// detectAccess() - Decides how to map a device from the driver it's bound to
+//=================================================================================================
+static PciDevice::access_t detectAccess(string deviceDir)
+{
+    error_code ec;
+    string driver = fs::read_symlink(deviceDir + "/driver", ec).filename().string();
+
+    if (driver == "vfio-pci") return PciDevice::ACCESS_VFIO;
+    if (driver.compare(0, 3, "uio") == 0 || fs::is_directory(deviceDir + "/uio", ec))
+    {
+        return PciDevice::ACCESS_UIO;
+    }
+    return PciDevice::ACCESS_DEVMEM;
+}
+//=================================================================================================
+
 
 //=================================================================================================
 // getResourceList() - Returns a vector of resource_t entries that describe each memory-mappable
@@ -161,7 +459,9 @@ void PciDevice::close()
 //        Each line contains 3 fields separated one space character:
 //           (1) The physical starting address of the memory mapped resource
 //           (2) The physical ending address of the memory mapped resource
-//           (3) A set of flags that we don't care about    
+//           (3) The resource's IORESOURCE_xxx flags
+//        The first 6 lines are the BARs; the lines after them are the expansion ROM and bridge
+//        windows, which aren't ours to map.  A BAR in I/O-port space can't be memory-mapped
 //=================================================================================================
 std::vector<PciDevice::resource_t> PciDevice::getResourceList(std::string deviceDir)
 {
@@ -177,25 +477,31 @@ std::vector<PciDevice::resource_t> PciDevice::getResourceList(std::string device
     // If we couldn't open the file, hand the caller an invalid value   
     if (!file.is_open()) throwRuntime("Can't open %s", c(filename));
     
-    // Loop through each line of the file...
-    while (getline(file, line))
+    // Loop through each line of the file.  Line "n" describes BAR "n"
+    for (int bar = 0; bar <= MAX_BAR && getline(file, line); ++bar)
     {
-        // Get pointers to the 1st and 2nd text fields of that line
+        // Get pointers to the 1st, 2nd and 3rd text fields of that line
         const char* p1 = c(line);
         const char* p2 = strchr(p1, ' ');
-        
-        // Parse the physical starting and ending address of this memory-mappable resource
-        off_t starting_address = strtoll(p1, 0, 0);
-        off_t ending_address   = strtoll(p2, 0, 0);
+        const char* p3 = p2 ? strchr(p2 + 1, ' ') : nullptr;
+        if (p3 == nullptr) continue;
+
+        // Parse the physical starting and ending address of this resource, and its flags
+        off_t    starting_address = strtoll(p1, 0, 0);
+        off_t    ending_address   = strtoll(p2, 0, 0);
+        uint64_t flags            = strtoull(p3, 0, 0);
 
         // A starting address of 0 means "this line doesn't define a memory-mappable resource"
         if (starting_address == 0) continue;
 
+        // I/O-port BARs can't be memory-mapped
+        if (flags & IORESOURCE_IO) continue;
+
         // Compute how many bytes long that memory region is
         size_t size = ending_address - starting_address + 1;
 
         // Append the description of this mappable resource into our result vector        
-        result.push_back({0, size, starting_address});
+        result.push_back({0, size, starting_address, bar});
     }
 
     // If there are no memory-mappable resources, create an error message
@@ -213,7 +519,7 @@ std::vector<PciDevice::resource_t> PciDevice::getResourceList(std::string device
 //         deviceDir = Name of the file-system directory where PCI device information can
 //                     be found.   If empty-string, a sensible default is used
 //=================================================================================================
-void PciDevice::open(string device, string deviceDir)
+void PciDevice::open(string device, string deviceDir, access_t access)
 {
     int vendorID=0, deviceID=0;
 
@@ -227,7 +533,7 @@ void PciDevice::open(string device, string deviceDir)
     if (p) deviceID = strtoul(p+1, 0, 16);
 
     // Now that we have the vendorID and deviceID as integers, call the regular "open" routine
-    open(vendorID, deviceID, deviceDir);
+    open(vendorID, deviceID, deviceDir, access);
 }
 //=================================================================================================
 
@@ -240,8 +546,9 @@ void PciDevice::open(string device, string deviceDir)
 //         deviceID  = The device ID of the PCIe device we're looking for
 //         deviceDir = Name of the file-system directory where PCI device information can
 //                     be found.   If empty-string, a sensible default is used
+//         access    = How the device's resources should be mapped
 //=================================================================================================
-void PciDevice::open(int vendorID, int deviceID, string deviceDir)
+void PciDevice::open(int vendorID, int deviceID, string deviceDir, access_t access)
 {
     string  dirName;
 
@@ -279,10 +586,39 @@ void PciDevice::open(int vendorID, int deviceID, string deviceDir)
     // If we couldn't find a device with that vendor ID and device ID, complain
     if (!found) throwRuntime("No PCI device found for vendor=0x%X, device=0x%X", vendorID, deviceID);
 
+    // The name of the device's directory is its PCI address
+    bdf_ = filesystem::path(dirName).filename().string();
+
+    // Find out which NUMA node the device hangs off of.  This is -1 on single-node machines
+    numaNode_ = getIntegerFromFile(dirName + "/numa_node");
+
     // Fetch the physical address and size of each resource (i.e. BAR) that our device supports
     resource_ = getResourceList(dirName);
 
-    // Memory map each of the PCI device resources into userspace
-    mapResources();
+    // Decide how to map the device, if the caller left it to us
+    if (access == ACCESS_AUTO) access = detectAccess(dirName);
+    access_ = access;
+
+    // Memory map each of the PCI device resources into userspace, and find out whether we can
+    // be told about its interrupts
+    try
+    {
+        if (access_ == ACCESS_VFIO)
+        {
+            mapVfioResources(dirName);
+            setupVfioInterrupts();
+        }
+        else if (access_ == ACCESS_UIO)
+        {
+            mapSysfsResources(dirName);
+            setupUioInterrupts(dirName);
+        }
+        else mapResources();
+    }
+    catch (...)
+    {
+        close();
+        throw;
+    }
 }
 //=================================================================================================
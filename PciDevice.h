@@ -1,7 +1,20 @@
 //=================================================================================================
 // PciDevice.h - Defines a generic class for mapping PCIe devices into user-space
+//
+// A device's BARs can be mapped in one of three ways:
+//
+//      ACCESS_DEVMEM - Through /dev/mem, at the physical addresses in sysfs.  Needs root, and
+//                      offers no interrupts
+//      ACCESS_VFIO   - Through the device file of a device bound to vfio-pci.  Interrupts (MSI
+//                      if the device has it, otherwise INTx) are delivered through an eventfd
+//      ACCESS_UIO    - Through the device's sysfs "resource<n>" files.  If the device is bound
+//                      to a UIO driver, interrupts are delivered through its /dev/uio<n>
+//
+// ACCESS_AUTO picks VFIO or UIO from the driver the device is bound to, and /dev/mem otherwise
 //=================================================================================================
 #pragma once
+#include <stdint.h>
+#include <sys/types.h>
 #include <string>
 #include <vector>
 
@@ -19,15 +32,40 @@ public:
     PciDevice (const PciDevice&) = delete;
     PciDevice& operator= (const PciDevice&) = delete;
 
-    // These each describe a memory mapped resource from a PCI device
-    struct resource_t {uint8_t* baseAddr; size_t size; off_t physAddr;};
+    // These each describe a memory mapped resource from a PCI device, and which BAR it is
+    struct resource_t {uint8_t* baseAddr; size_t size; off_t physAddr; int bar;};
+
+    // The ways a device can be mapped
+    enum access_t {ACCESS_AUTO, ACCESS_DEVMEM, ACCESS_VFIO, ACCESS_UIO};
 
     // Opens a connection to a PCIe device
-    void    open(int vendorID, int deviceID, std::string deviceDir = "");
-    void    open(std::string device, std::string deviceDir = "");
+    void    open(int vendorID, int deviceID, std::string deviceDir = "", access_t access = ACCESS_AUTO);
+    void    open(std::string device, std::string deviceDir = "", access_t access = ACCESS_AUTO);
+
+    // Converts the name of an access method ("auto", "devmem", "vfio", "uio") to an access_t,
+    // and back.  Throws runtime_error on an unknown name
+    static access_t parseAccess(std::string name);
+    static const char* accessName(access_t access);
+
+    // Returns the way the open device was mapped
+    access_t access() {return access_;}
+
+    // Returns a file descriptor that becomes readable when the device raises an interrupt
+    // (suitable for epoll), or -1 if the device's interrupts aren't available to us
+    int     interruptFd() {return irqFd_;}
+
+    // Call this after interruptFd() becomes readable: it consumes the interrupt and re-enables
+    // it.  Returns the number of interrupts since the last call
+    uint32_t acknowledgeInterrupt();
 
     // Fetches the list of memory mappable resources
     std::vector<resource_t>& resourceList() {return resource_;}
+
+    // Returns the PCI address (domain:bus:device.function) of the open device
+    std::string bdf() {return bdf_;}
+
+    // Returns the NUMA node the device is attached to, or -1 if unknown
+    int     numaNode() {return numaNode_;}
     
     // Stop access to the PCI device
     void    close();
@@ -37,9 +75,41 @@ protected:
     // Fetches the list of memory-mappable resources
     std::vector<resource_t> getResourceList(std::string deviceDir);
 
-    // Memory maps the resources whose definitions are in resource_
+    // Memory maps the resources whose definitions are in resource_, through /dev/mem, a VFIO
+    // device, or sysfs resource files
     void mapResources();
+    void mapVfioResources(std::string deviceDir);
+    void mapSysfsResources(std::string deviceDir);
+
+    // Sets up the interrupt file descriptor.  If the device's interrupts aren't available,
+    // irqFd_ remains -1
+    void setupVfioInterrupts();
+    void setupUioInterrupts(std::string deviceDir);
+
+    // Re-enables an interrupt after it's been delivered
+    void unmaskInterrupt();
 
     // Contains one entry for each resource (i.e, BAR) that is configured in the PCI device
     std::vector<resource_t> resource_;
+
+    // The PCI address of the device, i.e. the name of its sysfs directory
+    std::string bdf_;
+
+    // The NUMA node the device is attached to, from its sysfs directory
+    int     numaNode_ = -1;
+
+    // How the device is mapped
+    access_t access_ = ACCESS_DEVMEM;
+
+    // With VFIO: the container, group and device file descriptors, and which of the device's
+    // interrupts we're using
+    int     vfioContainer_ = -1;
+    int     vfioGroup_ = -1;
+    int     vfioDevice_ = -1;
+    int     vfioIrqIndex_ = -1;
+
+    // The eventfd (VFIO) or /dev/uio<n> (UIO) that interrupts are delivered through, and for
+    // UIO, the number of interrupts it had reported when we last read it
+    int     irqFd_ = -1;
+    uint32_t uioIrqCount_ = 0;
 };
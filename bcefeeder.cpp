@@ -0,0 +1,157 @@
+//=================================================================================================
+// bcefeeder.cpp - Implements the C interface of libbcefeeder on top of class Feeder
+//
+// No C++ exception ever crosses this interface.  Failures are caught here, their message is
+// saved for bce_last_error(), and the caller is handed -1
+//=================================================================================================
+#include <new>
+#include "bcefeeder.h"
+#include "feeder.h"
+using namespace std;
+
+// This is what a bce_feeder_t handle points to
+struct bce_feeder
+{
+    Feeder feeder;
+    string last_error;
+};
+
+
+//=================================================================================================
+// guarded() - Calls fn(), converting an exception into a saved error message and a return of -1
+//=================================================================================================
+template <class F> static int guarded(bce_feeder_t* handle, F fn)
+{
+    try
+    {
+        return fn();
+    }
+    catch(const std::exception& e)
+    {
+        handle->last_error = e.what();
+    }
+    catch(...)
+    {
+        handle->last_error = "unknown error";
+    }
+    return -1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_create() / bce_destroy() - Create and destroy a feeder instance
+//=================================================================================================
+bce_feeder_t* bce_create(void)
+{
+    return new(nothrow) bce_feeder;
+}
+
+void bce_destroy(bce_feeder_t* handle)
+{
+    delete handle;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_last_error() - Describes the most recent failure
+//=================================================================================================
+const char* bce_last_error(bce_feeder_t* handle)
+{
+    return handle->last_error.c_str();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// These set up the job
+//=================================================================================================
+int bce_read_config(bce_feeder_t* handle, const char* filename)
+{
+    return guarded(handle, [&]() {handle->feeder.read_config(filename); return 0;});
+}
+
+int bce_set_option(bce_feeder_t* handle, const char* name, uint32_t value)
+{
+    return guarded(handle, [&]() {handle->feeder.set_option(name, value); return 0;});
+}
+
+int bce_open_device(bce_feeder_t* handle)
+{
+    return guarded(handle, [&]() {handle->feeder.open_device(); return 0;});
+}
+
+int bce_attach_registers(bce_feeder_t* handle, void* base)
+{
+    return guarded(handle, [&]() {handle->feeder.attach_registers((uint8_t*)base); return 0;});
+}
+
+int bce_load_dataset(bce_feeder_t* handle)
+{
+    return guarded(handle, [&]() {handle->feeder.load_dataset(); return 0;});
+}
+
+int bce_set_frames(bce_feeder_t* handle, const bce_frame_t* frames, size_t count)
+{
+    return guarded(handle, [&]() {handle->feeder.set_frames(frames, count); return 0;});
+}
+
+int bce_listen(bce_feeder_t* handle, const char* path)
+{
+    return guarded(handle, [&]() {handle->feeder.listen(path); return 0;});
+}
+
+int bce_create_ring(bce_feeder_t* handle, const char* name)
+{
+    return guarded(handle, [&]() {handle->feeder.create_ring(name); return 0;});
+}
+
+void bce_set_callback(bce_feeder_t* handle, bce_bc_callback_t callback, void* context)
+{
+    if (callback == nullptr)
+        handle->feeder.on_bright_cycle(nullptr);
+    else
+        handle->feeder.on_bright_cycle([=](const bce_bc_info_t& info) {callback(context, &info);});
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_run() - Sends every frame.  Returns 0 when the job is complete, 1 if it was aborted
+//=================================================================================================
+int bce_run(bce_feeder_t* handle)
+{
+    return guarded(handle, [&]() {return handle->feeder.run() ? 0 : 1;});
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_abort() - Asks a running job to stop
+//=================================================================================================
+void bce_abort(bce_feeder_t* handle)
+{
+    handle->feeder.request_abort("bce_abort()");
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_get_stats() - Fetches the running totals for the current (or most recent) job
+//=================================================================================================
+void bce_get_stats(bce_feeder_t* handle, bce_stats_t* stats)
+{
+    *stats = handle->feeder.stats();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_get_cadence() - Fetches how closely the current (or most recent) job kept to its cadence
+//=================================================================================================
+void bce_get_cadence(bce_feeder_t* handle, bce_cadence_t* cadence)
+{
+    *cadence = handle->feeder.cadence_report();
+}
+//=================================================================================================
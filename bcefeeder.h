@@ -0,0 +1,137 @@
+//=================================================================================================
+// bcefeeder.h - The C interface of libbcefeeder, the engine that feeds frame-data to BC_EMU
+//
+// Typical use:
+//
+//      bce_feeder_t* feeder = bce_create();
+//      bce_read_config(feeder, "bce_feeder.conf");
+//      bce_open_device(feeder);
+//      bce_set_frames(feeder, frames, frame_count);
+//      bce_run(feeder);
+//      bce_destroy(feeder);
+//
+// Functions that can fail return 0 on success and -1 on failure, in which case bce_last_error()
+// describes what went wrong.  The C++ interface is class Feeder, in feeder.h
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// An instance of the feeder.  Each instance drives one device
+typedef struct bce_feeder bce_feeder_t;
+
+// A frame of data in caller memory: "size" 32-bit words starting at "data"
+typedef struct
+{
+    const uint32_t* data;
+    size_t          size;
+} bce_frame_t;
+
+// Describes a bright-cycle that has just started
+typedef struct
+{
+    uint32_t bc_count;          // The number of bright-cycles completed before this one
+    int32_t  frame_index;       // The index of the frame being sent
+    uint32_t fifo;              // The FIFO (0 or 1) the frame was loaded into
+    uint32_t crc;               // The CRC32C of the frame
+    uint32_t words;             // The number of words in the frame
+    uint32_t underruns;         // In streaming mode, how often the FIFO ran dry while loading
+    double   on_deck_ms;        // From the start of the FIFO load until the FIFO was on deck
+    double   load_ms;           // From the start of the FIFO load until it was fully loaded
+} bce_bc_info_t;
+
+// Running totals for the current (or most recent) job
+typedef struct
+{
+    uint64_t bright_cycles;     // Bright-cycles started
+    uint64_t words_written;     // Frame-data words written into the FIFOs
+    uint64_t stream_underruns;  // Times a FIFO ran dry while it was being streamed
+    double   last_load_ms;      // The load time of the most recent FIFO
+    double   max_load_ms;       // The longest FIFO load time
+    double   total_load_ms;     // The sum of all FIFO load times
+    uint64_t source_dry;        // Times a live frame source had no frame ready
+    uint64_t fifo_rearms;       // Bright-cycles sent from a FIFO that already held the frame
+} bce_stats_t;
+
+// How closely the current (or most recent) job kept to its cadence.  Jitter is how far each
+// interval between FIFO hand-offs was from the configured period
+typedef struct
+{
+    uint64_t hand_offs;         // FIFO hand-offs scheduled against the timeline
+    uint64_t missed_slots;      // Slots given up because a FIFO wasn't ready in time
+    double   target_period_us;  // The configured period, or 0 if there's no cadence
+    double   period_us;         // The average interval between hand-offs
+    double   jitter_p50_us;     // Half of the intervals were within this of the period
+    double   jitter_p99_us;     // 99% of the intervals were within this of the period
+    double   jitter_max_us;     // The furthest any interval was from the period
+} bce_cadence_t;
+
+// Producers that send frames over a socket (see bce_listen) precede each frame with this header,
+// followed by "words" 32-bit words in host byte order.  A header with "words" = 0 marks the end
+// of the stream: the job ends once every frame before it has been sent
+typedef struct
+{
+    uint32_t words;             // The number of words in the frame
+    uint32_t repeat;            // The number of times to send it, or 0 for the configured default
+} bce_frame_msg_t;
+
+// Called on the feeder's thread at the start of every bright-cycle.  Keep it short: the next
+// FIFO isn't loaded until it returns
+typedef void (*bce_bc_callback_t)(void* context, const bce_bc_info_t* info);
+
+// Creates and destroys a feeder instance
+bce_feeder_t* bce_create(void);
+void          bce_destroy(bce_feeder_t* feeder);
+
+// Describes the most recent failure
+const char*   bce_last_error(bce_feeder_t* feeder);
+
+// Reads settings from a configuration file, in the same format bce_feeder uses
+int           bce_read_config(bce_feeder_t* feeder, const char* filename);
+
+// Changes a single numeric setting, named as it is in the configuration file
+int           bce_set_option(bce_feeder_t* feeder, const char* name, uint32_t value);
+
+// Maps the configured PCI device and makes sure BC_EMU is idle
+int           bce_open_device(bce_feeder_t* feeder);
+
+// Uses a register space that the caller has already mapped (or a memory stand-in for one)
+int           bce_attach_registers(bce_feeder_t* feeder, void* base);
+
+// Reads the configured frame-data files
+int           bce_load_dataset(bce_feeder_t* feeder);
+
+// Sends frames straight from caller memory.  Nothing is copied, so the frames must remain
+// valid and unchanged until bce_run() returns
+int           bce_set_frames(bce_feeder_t* feeder, const bce_frame_t* frames, size_t count);
+
+// Instead of a fixed set of frames, sends frames received from producers that connect to a
+// unix-domain stream socket at "path"
+int           bce_listen(bce_feeder_t* feeder, const char* path);
+
+// Instead of a fixed set of frames, sends frames that a producer writes into a shared-memory ring
+// called "name".  The producer's side of the ring is in shm_ring.h
+int           bce_create_ring(bce_feeder_t* feeder, const char* name);
+
+// Arranges for "callback" to be called at the start of every bright-cycle
+void          bce_set_callback(bce_feeder_t* feeder, bce_bc_callback_t callback, void* context);
+
+// Sends every frame.  Returns 0 when the job is complete, 1 if it was aborted, -1 on failure
+int           bce_run(bce_feeder_t* feeder);
+
+// Asks a running job to stop.  Safe to call from any thread or from a signal handler
+void          bce_abort(bce_feeder_t* feeder);
+
+// Fetches the running totals for the current (or most recent) job
+void          bce_get_stats(bce_feeder_t* feeder, bce_stats_t* stats);
+
+// Fetches how closely the current (or most recent) job kept to its cadence
+void          bce_get_cadence(bce_feeder_t* feeder, bce_cadence_t* cadence);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,138 @@
+//=================================================================================================
+// cadence.cpp - Implements the timeline that FIFO hand-offs are scheduled against
+//=================================================================================================
+#include <math.h>
+#include <algorithm>
+#include "cadence.h"
+using namespace std;
+
+// Wake-up bias is never more than this.  A sleep that ends later than this is a scheduling
+// hiccup, not something to plan for
+static const int64_t MAX_WAKE_BIAS_NS = 1000000;
+
+
+//=================================================================================================
+// start() - Starts a new timeline at "hz" hand-offs per second
+//=================================================================================================
+void Cadence::start(double hz)
+{
+    period_ns_     = (hz > 0) ? llround(1e9 / hz) : 0;
+    slot_          = -1;
+    hand_offs_     = 0;
+    missed_        = 0;
+    jitter_max_ns_ = 0;
+    jitter_.assign(period_ns_ ? JITTER_BINS : 0, 0);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// next_slot() - Returns the slot of the next hand-off.  If we've fallen a whole period or more
+//               behind, the slots we missed are given up rather than being sent back-to-back
+//=================================================================================================
+int64_t Cadence::next_slot(int64_t now_ns)
+{
+    // The first hand-off starts the timeline
+    if (slot_ < 0)
+    {
+        t0_ns_ = now_ns;
+        slot_  = 0;
+        return t0_ns_;
+    }
+
+    ++slot_;
+    int64_t late_ns = now_ns - (t0_ns_ + slot_ * period_ns_);
+    if (late_ns >= period_ns_)
+    {
+        int64_t skip = late_ns / period_ns_;
+        slot_   += skip;
+        missed_ += skip;
+    }
+
+    return t0_ns_ + slot_ * period_ns_;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// woke() - Learns how late sleeps end.  The bias rises quickly and decays slowly, so that we'd
+//          rather spin a little longer than wake up after the slot
+//=================================================================================================
+void Cadence::woke(int64_t target_ns, int64_t now_ns)
+{
+    int64_t oversleep = min(max(now_ns - target_ns, (int64_t)0), MAX_WAKE_BIAS_NS);
+
+    if (oversleep > wake_bias_ns_)
+        wake_bias_ns_ += (oversleep - wake_bias_ns_) / 2;
+    else
+        wake_bias_ns_ -= (wake_bias_ns_ - oversleep) / 16;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// handed_off() - Records the hand-off for the current slot, and how far the interval since the
+//                previous one was from its ideal length
+//=================================================================================================
+void Cadence::handed_off(int64_t now_ns)
+{
+    if (hand_offs_++ == 0)
+        first_ns_ = now_ns;
+    else
+    {
+        int64_t ideal     = (slot_ - last_slot_) * period_ns_;
+        int64_t deviation = llabs((now_ns - last_ns_) - ideal);
+        jitter_[min((size_t)(deviation / JITTER_BIN_NS), JITTER_BINS - 1)] += 1;
+        jitter_max_ns_ = max(jitter_max_ns_, deviation);
+    }
+
+    last_ns_   = now_ns;
+    last_slot_ = slot_;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// jitter_percentile() - Returns (in microseconds) the deviation that "fraction" of the intervals
+//                       are no larger than, to the resolution of a histogram bin
+//=================================================================================================
+double Cadence::jitter_percentile(double fraction) const
+{
+    uint64_t intervals = hand_offs_ - 1;
+    uint64_t wanted = (uint64_t)ceil(fraction * intervals), count = 0;
+
+    for (size_t bin = 0; bin < jitter_.size(); ++bin)
+    {
+        count += jitter_[bin];
+        if (count >= wanted)
+        {
+            int64_t edge_ns = min((int64_t)(bin + 1) * JITTER_BIN_NS, jitter_max_ns_);
+            return edge_ns / 1000.0;
+        }
+    }
+
+    return jitter_max_ns_ / 1000.0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// report() - Summarizes the hand-offs since start()
+//=================================================================================================
+bce_cadence_t Cadence::report() const
+{
+    bce_cadence_t result = {};
+    if (!enabled()) return result;
+
+    result.hand_offs        = hand_offs_;
+    result.missed_slots     = missed_;
+    result.target_period_us = period_ns_ / 1000.0;
+    if (hand_offs_ < 2) return result;
+
+    result.period_us     = (last_ns_ - first_ns_) / 1000.0 / (hand_offs_ - 1);
+    result.jitter_p50_us = jitter_percentile(0.50);
+    result.jitter_p99_us = jitter_percentile(0.99);
+    result.jitter_max_us = jitter_max_ns_ / 1000.0;
+    return result;
+}
+//=================================================================================================
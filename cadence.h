@@ -0,0 +1,69 @@
+//=================================================================================================
+// cadence.h - Defines the timeline that FIFO hand-offs are scheduled against when bright-cycles
+//             must start at a fixed rate
+//
+// Slot n of the timeline is at t0 + n * period on CLOCK_MONOTONIC, where t0 is the first
+// hand-off.  Every slot is computed from t0 rather than from the hand-off before it, so a late
+// hand-off doesn't delay the ones after it and the error never accumulates.  The controller
+// also learns how late the thread wakes from a sleep, and wakes that much early, spinning out
+// the rest of the wait.  A hand-off that misses its slot by a whole period or more gives up the
+// slots it missed and is scheduled against the most recent one
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "bcefeeder.h"
+
+class Cadence
+{
+public:
+
+    // Starts a new timeline at "hz" hand-offs per second.  0 = No cadence
+    void    start(double hz);
+
+    // Returns true if hand-offs are being scheduled
+    bool    enabled() const {return period_ns_ != 0;}
+
+    // Returns the slot (CLOCK_MONOTONIC ns) of the next hand-off, given that it's now "now_ns".
+    // The first hand-off's slot is "now_ns" itself
+    int64_t next_slot(int64_t now_ns);
+
+    // Returns when to wake from a sleep in order to be at "slot_ns" on time
+    int64_t wake_time(int64_t slot_ns) const {return slot_ns - wake_bias_ns_;}
+
+    // Tells the controller that a sleep until "target_ns" actually ended at "now_ns"
+    void    woke(int64_t target_ns, int64_t now_ns);
+
+    // Records that the hand-off for the current slot took place at "now_ns"
+    void    handed_off(int64_t now_ns);
+
+    // Summarizes the hand-offs since start()
+    bce_cadence_t report() const;
+
+protected:
+
+    // The period and the first slot, in ns.  slot_ is the index of the current slot
+    int64_t period_ns_ = 0;
+    int64_t t0_ns_ = 0;
+    int64_t slot_ = -1;
+
+    // The number of hand-offs, the slots that were given up, and the first and last hand-off
+    uint64_t hand_offs_ = 0;
+    uint64_t missed_ = 0;
+    int64_t first_ns_ = 0;
+    int64_t last_ns_ = 0;
+    int64_t last_slot_ = 0;
+
+    // How much earlier than a slot we wake up, learned from how late sleeps end
+    int64_t wake_bias_ns_ = 0;
+
+    // The deviation of each interval between hand-offs from its ideal length, as a histogram
+    // with JITTER_BIN_NS per bin (the last bin holds everything beyond it), and the largest one
+    static const int64_t  JITTER_BIN_NS = 100;
+    static const size_t   JITTER_BINS   = 100000;
+    std::vector<uint64_t> jitter_;
+    int64_t               jitter_max_ns_ = 0;
+
+    // Returns the deviation that "fraction" of the intervals are no larger than
+    double  jitter_percentile(double fraction) const;
+};
@@ -0,0 +1,204 @@
+//=================================================================================================
+// column_layout.cpp - Implements how the columns of a multi-column CSV file become frame-data
+//                     words
+//
+// Like the transforms, the four-column kernels are written with GCC vector extensions, so they
+// compile to SSE2 on x86 and to NEON on ARM
+//=================================================================================================
+#include <string.h>
+#include <stdarg.h>
+#include <stdexcept>
+#include "column_layout.h"
+#include "config_file.h"
+using namespace std;
+
+// Four 32-bit words that are operated on as a unit
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parse() - Builds the layout from a script-spec.  The script is a single line, either
+//           "interleave <column> ..." or "pack <column> <bits> ..."
+//=================================================================================================
+void ColumnLayout::parse(CConfigScript& script)
+{
+    int token_count;
+
+    pack_ = false;
+    column_.clear();
+    bits_.clear();
+
+    while (script.get_next_line(&token_count))
+    {
+        if (!column_.empty()) throwRuntime("A column layout can only have one line");
+
+        string name = script.get_next_token(true);
+        if      (name == "interleave") pack_ = false;
+        else if (name == "pack"      ) pack_ = true;
+        else throwRuntime("Unknown column layout '%s'", name.c_str());
+
+        // Fetch the columns, and when packing, the width of each one's field
+        if (pack_ && (token_count % 2) == 0) throwRuntime("'pack' needs a <column> <bits> pair for each field");
+        for (int i=1; i<token_count; ++i)
+        {
+            int32_t column = script.get_next_int();
+            if (column < 0) throwRuntime("Invalid column %i in column layout", column);
+            column_.push_back(column);
+            if (!pack_) continue;
+
+            int32_t bits = script.get_next_int();
+            if (bits < 1 || bits > 32) throwRuntime("Invalid field width of %i bits in column layout", bits);
+            bits_.push_back(bits);
+            ++i;
+        }
+
+        if (column_.empty()) throwRuntime("'%s' needs a list of columns", name.c_str());
+    }
+
+    // Every field must fit in the word
+    uint32_t total = 0;
+    for (auto bits : bits_) total += bits;
+    if (total > 32) throwRuntime("Packed fields add up to %u bits, which won't fit in a word", total);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// apply() - Turns the rows of a frame into frame-data words
+//
+// Passed: frame   = The values read from a CSV file, row after row
+//         columns = The number of values in each row
+//=================================================================================================
+void ColumnLayout::apply(intvec_t& frame, size_t columns) const
+{
+    if (frame.empty()) return;
+
+    for (auto column : column_)
+    {
+        if (column >= columns) throwRuntime("Column layout uses column %u, but rows have %zu columns", column, columns);
+    }
+
+    if (pack_)
+        pack(frame, columns);
+    else
+        interleave(frame, columns);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// interleave() - Replaces each row with the values of the layout's columns, in layout order
+//=================================================================================================
+void ColumnLayout::interleave(intvec_t& frame, size_t columns) const
+{
+    const size_t rows   = frame.size() / columns;
+    const size_t width  = column_.size();
+    const uint32_t* in  = frame.data();
+
+    // Reordering the columns of a four-column row is a single vector shuffle, done in place
+    if (columns == 4 && width == 4)
+    {
+        const v4u32 mask = {column_[0], column_[1], column_[2], column_[3]};
+        uint32_t* p = frame.data();
+        for (size_t row = 0; row < rows; ++row, p += 4)
+        {
+            v4u32 v;
+            memcpy(&v, p, sizeof v);
+            v = __builtin_shuffle(v, mask);
+            memcpy(p, &v, sizeof v);
+        }
+        return;
+    }
+
+    // Otherwise the rows are gathered into a frame of a different size
+    intvec_t result(rows * width);
+    uint32_t* out = result.data();
+    for (size_t row = 0; row < rows; ++row, in += columns)
+    {
+        for (size_t i = 0; i < width; ++i) *out++ = in[column_[i]];
+    }
+    frame.swap(result);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// pack() - Replaces each row with a single word made of the layout's fields
+//=================================================================================================
+void ColumnLayout::pack(intvec_t& frame, size_t columns) const
+{
+    const size_t rows = frame.size() / columns;
+    const uint32_t* in = frame.data();
+    uint32_t* out = frame.data();
+    uint32_t overflow = 0;
+
+    // The mask and position of each field
+    vector<uint32_t> mask(column_.size()), shift(column_.size());
+    for (size_t i = 0, position = 0; i < column_.size(); position += bits_[i++])
+    {
+        mask[i]  = (bits_[i] == 32) ? 0xFFFFFFFF : (1u << bits_[i]) - 1;
+        shift[i] = position;
+    }
+
+    // With four columns, each column always goes to the same field, so a row is one vector:
+    // masked, shifted into place, and ORed together.  Unused columns have an empty mask
+    bool distinct = true;
+    for (size_t i = 0; i < column_.size(); ++i)
+    {
+        for (size_t j = 0; j < i; ++j) if (column_[i] == column_[j]) distinct = false;
+    }
+
+    if (columns == 4 && distinct)
+    {
+        v4u32 maskv = {0, 0, 0, 0}, shiftv = {0, 0, 0, 0}, overflowv = {0, 0, 0, 0};
+        for (size_t i = 0; i < column_.size(); ++i)
+        {
+            maskv [column_[i]] = mask[i];
+            shiftv[column_[i]] = shift[i];
+        }
+        v4u32 used = (v4u32)(maskv != 0);
+
+        for (size_t row = 0; row < rows; ++row, in += 4)
+        {
+            v4u32 v;
+            memcpy(&v, in, sizeof v);
+            overflowv |= v & ~maskv & used;
+            v = (v & maskv) << shiftv;
+            *out++ = v[0] | v[1] | v[2] | v[3];
+        }
+        overflow = overflowv[0] | overflowv[1] | overflowv[2] | overflowv[3];
+    }
+
+    // Otherwise, a field at a time.  The output never overtakes the input, so this is in place
+    else for (size_t row = 0; row < rows; ++row, in += columns)
+    {
+        uint32_t word = 0;
+        for (size_t i = 0; i < column_.size(); ++i)
+        {
+            uint32_t value = in[column_[i]];
+            overflow |= value & ~mask[i];
+            word |= (value & mask[i]) << shift[i];
+        }
+        *out++ = word;
+    }
+
+    if (overflow) throwRuntime("A column value is too wide for its packed field");
+    frame.resize(rows);
+}
+//=================================================================================================
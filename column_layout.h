@@ -0,0 +1,52 @@
+//=================================================================================================
+// column_layout.h - Defines how the columns of a multi-column CSV file become frame-data words
+//
+// A multi-channel CSV file has one column per channel and one row per sample.  Normally every
+// value on every row is simply appended to the frame.  A column layout instead turns each row
+// into words in one of two ways:
+//
+//      interleave <c0> <c1> ...            : each row becomes the values of columns c0, c1, ...
+//                                            in that order.  A column can be left out, or used
+//                                            more than once
+//      pack <c0> <bits0> <c1> <bits1> ...  : each row becomes a single word, with column c0 in
+//                                            its low "bits0" bits, column c1 in the next "bits1"
+//                                            bits, and so on.  A value that doesn't fit in its
+//                                            field is an error
+//
+// Every row of the file must have the same number of columns
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "frame_reader.h"
+
+class CConfigScript;
+
+class ColumnLayout
+{
+public:
+
+    // Builds the layout from a script-spec in the configuration file
+    void    parse(CConfigScript& script);
+
+    // Returns true if no layout is configured
+    bool    empty() const {return column_.empty();}
+
+    // Turns the rows of a frame (as read, "columns" values per row) into frame-data words.
+    // Throws runtime_error if the layout doesn't fit the frame
+    void    apply(intvec_t& frame, size_t columns) const;
+
+protected:
+
+    // Each row either has its columns interleaved, or packed into a single word
+    bool    pack_ = false;
+
+    // The columns that make up each row's words, and when packing, each one's field width
+    std::vector<uint32_t> column_;
+    std::vector<uint32_t> bits_;
+
+    // The two ways of applying the layout
+    void    interleave(intvec_t& frame, size_t columns) const;
+    void    pack(intvec_t& frame, size_t columns) const;
+};
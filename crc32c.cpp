@@ -0,0 +1,133 @@
+//=================================================================================================
+// crc32c.cpp - Implements a hardware-accelerated CRC32C (Castagnoli) checksum
+//
+// On x86 CPUs with SSE4.2 and on ARMv8 CPUs with the CRC extension, the checksum is computed
+// with the CPU's crc32c instructions.  Everywhere else, a table-driven version is used.
+// The choice is made once, at run time
+//=================================================================================================
+#include <string.h>
+#include "crc32c.h"
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+// The CRC32C polynomial, in reversed bit order
+static const uint32_t POLYNOMIAL = 0x82F63B78;
+
+
+//=================================================================================================
+// crc32c_table() - Computes the CRC32C one byte at a time with a lookup table
+//=================================================================================================
+static uint32_t crc32c_table(const uint8_t* p, size_t length, uint32_t crc)
+{
+    static uint32_t table[256];
+
+    // Build the lookup table the first time we're called
+    static bool initialized = [](){
+        for (uint32_t i=0; i<256; ++i)
+        {
+            uint32_t value = i;
+            for (int bit=0; bit<8; ++bit) value = (value >> 1) ^ (POLYNOMIAL & -(value & 1));
+            table[i] = value;
+        }
+        return true;
+    }();
+    (void)initialized;
+
+    while (length--) crc = (crc >> 8) ^ table[(crc ^ *p++) & 0xFF];
+    return crc;
+}
+//=================================================================================================
+
+
+#if defined(__x86_64__)
+//=================================================================================================
+// crc32c_hw() - Computes the CRC32C using the SSE4.2 crc32 instruction
+//=================================================================================================
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(const uint8_t* p, size_t length, uint32_t crc)
+{
+    uint64_t crc64 = crc;
+    while (length >= 8)
+    {
+        uint64_t value;
+        memcpy(&value, p, 8);
+        crc64 = _mm_crc32_u64(crc64, value);
+        p += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (length--) crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+//=================================================================================================
+
+static bool have_hw_crc() {return __builtin_cpu_supports("sse4.2");}
+static const char* HW_NAME = "SSE4.2";
+
+#elif defined(__aarch64__)
+//=================================================================================================
+// crc32c_hw() - Computes the CRC32C using the ARMv8 crc32c instructions
+//=================================================================================================
+__attribute__((target("+crc")))
+static uint32_t crc32c_hw(const uint8_t* p, size_t length, uint32_t crc)
+{
+    while (length >= 8)
+    {
+        uint64_t value;
+        memcpy(&value, p, 8);
+        crc = __crc32cd(crc, value);
+        p += 8;
+        length -= 8;
+    }
+    while (length--) crc = __crc32cb(crc, *p++);
+    return crc;
+}
+//=================================================================================================
+
+static bool have_hw_crc() {return getauxval(AT_HWCAP) & HWCAP_CRC32;}
+static const char* HW_NAME = "ARMv8 CRC";
+
+#else
+static uint32_t crc32c_hw(const uint8_t* p, size_t length, uint32_t crc) 
+{
+    return crc32c_table(p, length, crc);
+}
+static bool have_hw_crc() {return false;}
+static const char* HW_NAME = "table";
+#endif
+
+
+// This is true if this CPU has crc32c instructions
+static const bool use_hw = have_hw_crc();
+
+
+//=================================================================================================
+// crc32c() - Computes the CRC32C of a block of memory
+//
+// Passed: data   = Pointer to the data to checksum
+//         length = Number of bytes to checksum
+//         crc    = The CRC of any preceding data, or 0 for the start of the data
+//=================================================================================================
+uint32_t crc32c(const void* data, size_t length, uint32_t crc)
+{
+    auto p = (const uint8_t*)data;
+    crc = ~crc;
+    crc = use_hw ? crc32c_hw(p, length, crc) : crc32c_table(p, length, crc);
+    return ~crc;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// crc32c_implementation() - Returns the name of the implementation crc32c() uses on this CPU
+//=================================================================================================
+const char* crc32c_implementation()
+{
+    return use_hw ? HW_NAME : "table";
+}
+//=================================================================================================
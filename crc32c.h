@@ -0,0 +1,13 @@
+//=================================================================================================
+// crc32c.h - Defines a hardware-accelerated CRC32C (Castagnoli) checksum
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Computes the CRC32C of a block of memory.  To checksum data in pieces, pass the
+// result of the previous call as "crc"
+uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0);
+
+// Returns the name of the implementation that crc32c() uses on this CPU
+const char* crc32c_implementation();
@@ -0,0 +1,210 @@
+//=================================================================================================
+// dir_watch.cpp - Implements a background watcher that notices when frame-data files in a
+//                 directory are created, modified or deleted
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+#include "dir_watch.h"
+using namespace std;
+namespace fs = std::filesystem;
+
+// A burst of events is complete once the directory has been quiet this long
+static const int SETTLE_MS = 20;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start() - Subscribes to inotify events on the directory and starts the watcher thread
+//=================================================================================================
+void DirWatcher::start(string dir, vector<string> extensions, function<void(file_change_t&)> loader)
+{
+    // If we're already watching, stop
+    stop();
+
+    // A file is finished when it's closed after writing, or renamed into place.  It's gone
+    // when it's deleted or renamed away
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) throwRuntime("Can't create an inotify instance: %s", strerror(errno));
+    if (inotify_add_watch(inotify_fd_, dir.c_str(), mask) < 0)
+    {
+        int error = errno;
+        ::close(inotify_fd_);
+        inotify_fd_ = -1;
+        throwRuntime("Can't watch %s: %s", dir.c_str(), strerror(error));
+    }
+
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (stop_fd_ < 0) throwRuntime("Can't create an eventfd: %s", strerror(errno));
+
+    dir_       = dir;
+    extensions_ = extensions;
+    loader_    = loader;
+    pending_.clear();
+    has_changes_ = false;
+
+    thread_ = std::thread(&DirWatcher::watch_thread, this);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop() - Stops the watcher thread and closes the inotify instance
+//=================================================================================================
+void DirWatcher::stop()
+{
+    // If we're not watching, there's nothing to do
+    if (inotify_fd_ < 0) return;
+
+    // Wake the thread and wait for it to quit
+    uint64_t one = 1;
+    if (write(stop_fd_, &one, sizeof one) < 0) perror("DirWatcher::stop");
+    if (thread_.joinable()) thread_.join();
+
+    ::close(inotify_fd_);
+    ::close(stop_fd_);
+    inotify_fd_ = stop_fd_ = -1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// take_changes() - Collects every change that's ready, in filename order
+//
+// Returns: false if there were no changes waiting
+//=================================================================================================
+bool DirWatcher::take_changes(vector<file_change_t>& changes)
+{
+    changes.clear();
+    if (!has_changes_) return false;
+
+    lock_guard<mutex> lock(mutex_);
+    for (auto& entry : pending_) changes.push_back(std::move(entry.second));
+    pending_.clear();
+    has_changes_ = false;
+    return !changes.empty();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_events() - Reads every pending inotify event.  The name of each file that has one of the
+//                 extensions we care about is added to "names"
+//=================================================================================================
+void DirWatcher::read_events(set<string>& names)
+{
+    alignas(inotify_event) char buffer[16384];
+
+    while (true)
+    {
+        ssize_t length = read(inotify_fd_, buffer, sizeof buffer);
+        if (length <= 0) return;
+
+        for (char* p = buffer; p < buffer + length; )
+        {
+            auto event = (inotify_event*)p;
+            p += sizeof(inotify_event) + event->len;
+
+            // If events were lost, every file might have changed
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                for (auto& entry : fs::directory_iterator(dir_))
+                {
+                    if (is_wanted(entry.path())) names.insert(entry.path());
+                }
+                continue;
+            }
+
+            if (event->len == 0) continue;
+            fs::path path = fs::path(dir_) / event->name;
+            if (is_wanted(path)) names.insert(path.string());
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// is_wanted() - Returns true if a file has one of the extensions we care about
+//=================================================================================================
+bool DirWatcher::is_wanted(const string& filename) const
+{
+    string extension = fs::path(filename).extension();
+    return find(extensions_.begin(), extensions_.end(), extension) != extensions_.end();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// watch_thread() - Waits for a burst of inotify events, then prepares a change for every file
+//                  that was mentioned.  Whether the file was created, modified or deleted is
+//                  decided by the loader, from the state of the file once the burst is over
+//=================================================================================================
+void DirWatcher::watch_thread()
+{
+    pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+
+    while (true)
+    {
+        set<string> names;
+
+        // Wait for the first event, then keep collecting until the directory is quiet
+        int timeout = -1;
+        while (true)
+        {
+            int count = poll(fds, 2, timeout);
+            if (count < 0 && errno == EINTR) continue;
+            if (count < 0 || (fds[1].revents & POLLIN)) return;
+            if (count == 0) break;
+            read_events(names);
+            timeout = SETTLE_MS;
+        }
+
+        // Prepare a change for every file that was mentioned.  A file we can't use is reported
+        // and left as it was
+        for (auto& name : names)
+        {
+            file_change_t change = {name, false, {}, 0};
+            try
+            {
+                loader_(change);
+            }
+            catch(const exception& e)
+            {
+                fprintf(stderr, "Ignoring change to %s: %s\n", name.c_str(), e.what());
+                continue;
+            }
+
+            // Hand the change over.  A newer change to a file replaces one not yet collected
+            lock_guard<mutex> lock(mutex_);
+            pending_[change.filename] = std::move(change);
+            has_changes_ = true;
+        }
+    }
+}
+//=================================================================================================
@@ -0,0 +1,89 @@
+//=================================================================================================
+// dir_watch.h - Defines a background watcher that notices when frame-data files in a directory
+//               are created, modified or deleted, and prepares the replacement frames
+//
+// The watcher uses inotify.  Events are collected until the directory has been quiet for a short
+// while, so a file that's written in several steps is only re-read once.  For each changed file
+// the caller's "loader" runs on the watcher's thread, and the prepared changes wait until the
+// caller collects them with take_changes()
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include "frame_reader.h"
+
+// A change to one file in the watched directory
+struct file_change_t
+{
+    std::string filename;       // The path of the file, as the directory listing would give it
+    bool        deleted;        // True if the file no longer exists
+    intvec_t    data;           // The file's new frame-data
+    uint32_t    crc;            // The CRC32C of the new frame-data
+};
+
+class DirWatcher
+{
+public:
+
+    // Constructor and destructor
+    DirWatcher() {}
+    ~DirWatcher() {stop();}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    DirWatcher(const DirWatcher&) = delete;
+    DirWatcher& operator= (const DirWatcher&) = delete;
+
+    // Starts watching a directory
+    //
+    // Passed: dir       = The directory to watch
+    //         extensions = Only files with one of these extensions (e.g., ".csv") are of
+    //                      interest
+    //         loader    = Called on the watcher's thread to fill in each change.  On entry,
+    //                     "filename" is filled in.  It throws if the file can't be used
+    void    start(std::string dir, std::vector<std::string> extensions,
+                  std::function<void(file_change_t&)> loader);
+
+    // Stops watching
+    void    stop();
+
+    // Returns true if there are changes waiting to be collected
+    bool    has_changes() const {return has_changes_;}
+
+    // Collects every change that's ready, in filename order.  Returns false if there were none
+    bool    take_changes(std::vector<file_change_t>& changes);
+
+protected:
+
+    // The background thread that waits for inotify events and prepares the changes
+    void    watch_thread();
+
+    // Reads the pending inotify events, adding the interesting filenames to "names"
+    void    read_events(std::set<std::string>& names);
+
+    // Returns true if a file has one of the extensions we care about
+    bool    is_wanted(const std::string& filename) const;
+
+    // The directory, the extensions we care about, and the loader
+    std::string dir_;
+    std::vector<std::string> extensions_;
+    std::function<void(file_change_t&)> loader_;
+
+    // The inotify descriptor, and an eventfd that tells the thread to quit
+    int     inotify_fd_ = -1;
+    int     stop_fd_ = -1;
+
+    // Prepared changes, keyed by filename, guarded by mutex_
+    std::map<std::string, file_change_t> pending_;
+    std::mutex        mutex_;
+    std::atomic<bool> has_changes_{false};
+
+    // The watcher thread
+    std::thread thread_;
+};
@@ -0,0 +1,3006 @@
+//=================================================================================================
+// feeder.cpp - Implements the engine that feeds frame-data to BC_EMU, one bright-cycle at a time
+//=================================================================================================
+#include <unistd.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <filesystem>
+#include <algorithm>
+#include <map>
+#include <future>
+#include "feeder.h"
+#include "config_file.h"
+#include "crc32c.h"
+#include "parallel.h"
+using namespace std;
+namespace fs = std::filesystem;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// check_streaming() - Throws if streaming mode is on but the FIFO depth or fill-level registers
+//                     that it needs haven't been configured.  BC_EMU has no documented offsets
+//                     for those registers, so there is nothing sensible to fall back on
+//=================================================================================================
+static void check_streaming(const feeder_config_t& c)
+{
+    if (c.stream_prefix == 0) return;
+
+    if (c.fifo_depth == 0) throwRuntime("fifo_depth must be non-zero in streaming mode");
+    if (c.registers[REG_FIFO0_LEVEL] == 0 || c.registers[REG_FIFO1_LEVEL] == 0)
+    {
+        throwRuntime("reg_fifo0_level and reg_fifo1_level must be configured in streaming mode");
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_config() - Reads the job settings from a configuration file
+//=================================================================================================
+void Feeder::read_config(string filename)
+{
+    CConfigFile cf;
+    CConfigScript s;
+    feeder_config_t& c = config;
+
+    // Read the configuration file
+    if (!cf.read(filename, false)) throwRuntime("Can't read %s", filename.c_str());
+
+    // Fetch the VendorID:DeviceID of the PCI device we're interested in
+    cf.get("pci_device", &c.pci_device);
+
+    // Fetch the way the device should be mapped
+    if (cf.exists("device_access"))
+    {
+        string method;
+        cf.get("device_access", &method);
+        c.device_access = PciDevice::parseAccess(method);
+    }
+
+    // Fetch the directory that PCI devices are looked for in
+    if (cf.exists("device_dir")) cf.get("device_dir", &c.device_dir);
+
+    // Find out whether we should wait on the device's interrupts
+    if (cf.exists("interrupts"))
+    {
+        cf.get("interrupts", &c.interrupts);
+    }
+
+    // Fetch the offsets of the registers.  Any that aren't configured keep the BC_EMU default
+    for (int id = 0; id < REG_COUNT; ++id)
+    {
+        string key = string("reg_") + register_map_t::name((reg_id_t)id);
+        if (cf.exists(key)) cf.get(key, &c.registers.offset[id]);
+    }
+
+    // Find out whether register accesses should be counted
+    if (cf.exists("count_registers"))
+    {
+        cf.get("count_registers", &c.count_registers);
+    }
+
+    // Fetch the method we should use to read frame-data files
+    if (cf.exists("read_method"))
+    {
+        string method;
+        cf.get("read_method", &method);
+        c.read_method = parse_read_method(method);
+    }
+
+    // Find out whether frame-data files should be parsed in the background
+    if (cf.exists("progressive_load"))
+    {
+        cf.get("progressive_load", &c.progressive_load);
+    }
+
+    // Fetch the number of spans the timeline can hold
+    if (cf.exists("trace_capacity"))
+    {
+        cf.get("trace_capacity",  &c.trace_capacity        );
+    }
+
+    // Fetch the number of datasets to keep in memory
+    if (cf.exists("dataset_cache"))
+    {
+        cf.get("dataset_cache",   &c.dataset_cache         );
+    }
+
+    // Fetch the per-word pacing of FIFO loads
+    if (cf.exists("word_delay_us"))
+    {
+        cf.get("word_delay_us",   &c.word_delay_us         );
+    }
+
+    // Fetch the number of words written between delays
+    if (cf.exists("burst_size"))
+    {
+        cf.get("burst_size",      &c.burst_size            );
+        if (c.burst_size == 0) throwRuntime("burst_size must be non-zero");
+    }
+
+    // Fetch the settings for pacing calibration
+    if (cf.exists("profile_dir"))
+    {
+        cf.get("profile_dir",     &c.profile_dir           );
+    }
+
+    if (cf.exists("calibrate_trials"))
+    {
+        cf.get("calibrate_trials", &c.calibrate_trials     );
+    }
+
+    // Calibration needs to know which bits of reg_fifo_status report a FIFO overflow...
+    if (cf.exists("fifo_overflow_mask"))
+    {
+        cf.get("fifo_overflow_mask", &c.fifo_overflow_mask    );
+    }
+
+    // ...and which report a FIFO underrun
+    if (cf.exists("fifo_underrun_mask"))
+    {
+        cf.get("fifo_underrun_mask", &c.fifo_underrun_mask    );
+    }
+
+    // If the RTL can retain what's in a FIFO after sending it, fetch the bits that ask it to
+    if (cf.exists("fifo_retain_mask"))
+    {
+        cf.get("fifo_retain_mask", &c.fifo_retain_mask    );
+        if (c.fifo_retain_mask & 1) throwRuntime("fifo_retain_mask can't include bit 0 of reg_cont_mode");
+    }
+
+    // Fetch the duration of a bright-cycle
+    if (cf.exists("bc_duration_us"))
+    {
+        cf.get("bc_duration_us",  &c.bc_duration_us        );
+    }
+
+    // If the FIFO depth is known, fetch it
+    if (cf.exists("fifo_depth"))
+    {
+        cf.get("fifo_depth",      &c.fifo_depth            );
+    }
+
+    // Fetch the settings that govern aborts and timeouts
+    if (cf.exists("abort_latency_us"))
+    {
+        cf.get("abort_latency_us", &c.abort_latency_us     );
+    }
+
+    if (cf.exists("wait_timeout_ms"))
+    {
+        cf.get("wait_timeout_ms", &c.wait_timeout_ms       );
+    }
+
+    // Fetch the settings for streaming mode
+    if (cf.exists("stream_prefix"))
+    {
+        cf.get("stream_prefix",   &c.stream_prefix         );
+    }
+
+    // Fetch the rate at which bright-cycles should start
+    if (cf.exists("cadence_hz"))
+    {
+        cf.get("cadence_hz",      &c.cadence_hz            );
+        if (c.cadence_hz < 0) throwRuntime("cadence_hz can't be negative");
+    }
+
+    // Streaming mode needs to know how full the FIFOs are
+    check_streaming(c);
+
+    // If the columns of each CSV row are to be interleaved or packed, fetch the layout
+    if (cf.exists("columns"))
+    {
+        cf.get("columns", &s);
+        c.columns.parse(s);
+    }
+
+    // If there are transforms to apply to the frame-data, fetch them
+    if (cf.exists("transforms"))
+    {
+        cf.get("transforms", &s);
+        c.transform.parse(s);
+    }
+
+    // If there is a manifest of expected CRCs, fetch its name
+    if (cf.exists("crc_manifest"))
+    {
+        cf.get("crc_manifest", &c.crc_manifest);
+    }
+
+    // If the dataset is a patch file, fetch its name
+    if (cf.exists("patch_file"))
+    {
+        cf.get("patch_file", &c.patch_file);
+    }
+
+    // If the dataset is a frame pack, fetch its name
+    if (cf.exists("frame_pack"))
+    {
+        cf.get("frame_pack", &c.frame_pack);
+    }
+
+    // If frames are to come from a socket, fetch its name
+    if (cf.exists("frame_socket"))
+    {
+        cf.get("frame_socket", &c.frame_socket);
+    }
+
+    // Fetch the settings that govern the queue of received frames
+    if (cf.exists("queue_depth"))
+    {
+        cf.get("queue_depth",     &c.queue_depth           );
+        if (c.queue_depth == 0) throwRuntime("queue_depth must be non-zero");
+    }
+
+    // If frames are to come from a shared-memory ring, fetch its name and shape
+    if (cf.exists("shm_ring"))
+    {
+        cf.get("shm_ring", &c.shm_ring);
+    }
+
+    if (cf.exists("shm_slots"))
+    {
+        cf.get("shm_slots",       &c.shm_slots             );
+    }
+
+    if (cf.exists("shm_slot_words"))
+    {
+        cf.get("shm_slot_words",  &c.shm_slot_words        );
+    }
+
+    if (cf.exists("dry_policy"))
+    {
+        string policy;
+        cf.get("dry_policy", &policy);
+        c.dry_policy = parse_dry_policy(policy);
+    }
+
+    // Find out whether the dataset directory should be watched for changes
+    if (cf.exists("watch"))
+    {
+        cf.get("watch", &c.watch);
+    }
+
+    // Find out where frame-data and the feeder thread should live
+    if (cf.exists("numa"))
+    {
+        cf.get("numa", &c.numa);
+    }
+
+    if (cf.exists("huge_pages"))
+    {
+        cf.get("huge_pages", &c.huge_pages);
+    }
+
+    // If "data_files" exists in the configuration file, fetch a list
+    // of data-files to use as frame-data
+    if (cf.exists("data_files"))
+    {
+        cf.get("data_files", &s);
+        while (s.get_next_line())
+        {
+            auto filename = s.get_next_token();
+            c.data_files.push_back(filename);
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parse_dry_policy() - Converts the name of a dry policy to a dry_policy_t
+//=================================================================================================
+dry_policy_t parse_dry_policy(string name)
+{
+    if (name == "repeat") return DRY_REPEAT;
+    if (name == "wait"  ) return DRY_WAIT;
+    if (name == "stop"  ) return DRY_STOP;
+    throwRuntime("Unknown dry_policy '%s'", name.c_str());
+    return DRY_REPEAT;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// set_option() - Changes a single numeric setting, named as it is in the configuration file
+//=================================================================================================
+void Feeder::set_option(string name, uint32_t value)
+{
+    feeder_config_t& c = config;
+
+    const pair<const char*, uint32_t*> options[] =
+    {
+        {"fifo_depth",         &c.fifo_depth            },
+        {"word_delay_us",      &c.word_delay_us         },
+        {"burst_size",         &c.burst_size            },
+        {"calibrate_trials",   &c.calibrate_trials      },
+        {"fifo_overflow_mask", &c.fifo_overflow_mask    },
+        {"fifo_underrun_mask", &c.fifo_underrun_mask    },
+        {"fifo_retain_mask",   &c.fifo_retain_mask      },
+        {"bc_duration_us",     &c.bc_duration_us        },
+        {"abort_latency_us",   &c.abort_latency_us      },
+        {"wait_timeout_ms",    &c.wait_timeout_ms       },
+        {"stream_prefix",      &c.stream_prefix         },
+        {"queue_depth",        &c.queue_depth           },
+        {"shm_slots",          &c.shm_slots             },
+        {"shm_slot_words",     &c.shm_slot_words        },
+        {"dataset_cache",      &c.dataset_cache         },
+        {"trace_capacity",     &c.trace_capacity        },
+    };
+
+    // The on/off settings
+    const pair<const char*, bool*> flags[] =
+    {
+        {"verbose",            &c.verbose               },
+        {"watch",              &c.watch                 },
+        {"numa",               &c.numa                  },
+        {"huge_pages",         &c.huge_pages            },
+        {"count_registers",    &c.count_registers       },
+        {"progressive_load",   &c.progressive_load      },
+        {"interrupts",         &c.interrupts            },
+    };
+
+    for (auto& flag : flags)
+    {
+        if (name == flag.first) {*flag.second = value; return;}
+    }
+
+    // These two aren't unsigned integers
+    if (name == "max_repeats") {c.max_repeats = value; return;}
+    if (name == "cadence_hz")  {c.cadence_hz = value; return;}
+
+    // Register offsets are named "reg_<register>"
+    for (int id = 0; id < REG_COUNT; ++id)
+    {
+        if (name == string("reg_") + register_map_t::name((reg_id_t)id))
+        {
+            c.registers.offset[id] = value;
+            return;
+        }
+    }
+
+    if (name == "burst_size"  && value == 0) throwRuntime("burst_size must be non-zero");
+    if (name == "queue_depth" && value == 0) throwRuntime("queue_depth must be non-zero");
+    if (name == "fifo_retain_mask" && (value & 1)) throwRuntime("fifo_retain_mask can't include bit 0 of reg_cont_mode");
+
+    for (auto& option : options)
+    {
+        if (name == option.first) {*option.second = value; return;}
+    }
+
+    throwRuntime("Unknown option '%s'", name.c_str());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// attach_registers() - Computes the userspace address of each BC_EMU register
+//
+// Passed: base_ptr = Userspace address of the start of the register space.  This is either the
+//                    device's BAR or a memory-backed stand-in for it
+//=================================================================================================
+void Feeder::attach_registers(uint8_t* base_ptr)
+{
+    // Either count every access, or go straight to the registers
+    reg_access_ = config.count_registers ? ACCESS_COUNTING : ACCESS_MMIO;
+    with_registers([&](auto& regs) {regs.attach(base_ptr, config.registers);});
+    fifos_reset_ = false;
+    start_span_trace();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// attach_memory_registers() - Points the BC_EMU registers at a memory-backed stand-in for the
+//                             device's register space
+//
+// Passed: size = The minimum size (in bytes) of the register space
+//=================================================================================================
+void Feeder::attach_memory_registers(uint32_t size)
+{
+    // The register space is created big enough to hold every register, with every register
+    // initialized to zero
+    reg_access_ = ACCESS_MEMORY;
+    memory_regs_.attach(nullptr, config.registers, size);
+    fifos_reset_ = false;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// open_device() - Maps the PCI device into userspace, makes sure the correct version of BC_EMU
+//                 is loaded and that it's idle
+//
+// Passed: use_profile = If true, the pacing profile for this device (if any) is used
+//=================================================================================================
+void Feeder::open_device(bool use_profile)
+{
+    map_device();
+    init_device(use_profile);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start_up() - Opens the device while the frames are being prepared on another thread, then
+//              resets the FIFOs, so that the first bright-cycle can start as soon as both are
+//              done.  Mapping the device comes first, so the thread that prepares the frames
+//              is already on the card's NUMA node
+//=================================================================================================
+void Feeder::start_up(function<void()> prepare_frames, bool use_profile)
+{
+    map_device();
+
+    // Prepare the frames in the background, noting how long it takes
+    chrono::steady_clock::time_point prepare_start, prepare_end;
+    auto prepared = async(launch::async, [&]()
+    {
+        span_trace_.name_thread("startup");
+        TraceScope span(span_trace_, "prepare frames", "startup");
+        prepare_start = chrono::steady_clock::now();
+        prepare_frames();
+        prepare_end = chrono::steady_clock::now();
+    });
+
+    // Meanwhile, get BC_EMU ready.  If that fails, we still wait for the frames, because the
+    // other thread is using this object
+    try
+    {
+        init_device(use_profile);
+        auto reset_start = chrono::steady_clock::now();
+        reset_fifos();
+        fifos_reset_ = true;
+        note_startup_phase("FIFO reset", reset_start);
+    }
+    catch(...)
+    {
+        prepared.wait();
+        throw;
+    }
+
+    prepared.get();
+
+    // If the frames came from a directory, listing it and reading the files are reported apart
+    if (dir_scan_start_ >= prepare_start && dir_scan_end_ <= prepare_end)
+    {
+        note_startup_phase("scan directory", dir_scan_start_, dir_scan_end_, true);
+        note_startup_phase("load dataset", dir_scan_end_, prepare_end, true);
+    }
+    else note_startup_phase("prepare frames", prepare_start, prepare_end, true);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// map_device() - Maps the PCI device and moves us next to it
+//=================================================================================================
+void Feeder::map_device()
+{
+    auto start_time = chrono::steady_clock::now();
+    start_span_trace();
+
+    // Map the PCI-device's memory into userspace
+    device_.open(config.pci_device, config.device_dir, config.device_access);
+
+    // Keep ourselves (and the frame-data we're about to read) close to the card
+    place_on_device_node();
+
+    note_startup_phase("map device", start_time);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// init_device() - Makes sure BC_EMU is loaded and idle, and loads the device's pacing profile
+//=================================================================================================
+void Feeder::init_device(bool use_profile)
+{
+    auto start_time = chrono::steady_clock::now();
+
+    // Compute the addresses of the BC_EMU registers within the device's first resource
+    attach_registers(device_.resourceList()[0].baseAddr);
+
+    // If the user wants a trace of register accesses, start recording them
+    if (!config.reg_trace_file.empty())
+    {
+        reg_trace_.start(config.reg_trace_file);
+        reg_access_ = ACCESS_TRACED;
+        traced_regs_.attach(device_.resourceList()[0].baseAddr, config.registers);
+    }
+
+    // Check to make sure that BC_EMU is actually loaded!
+    if (reg_read(REG_RTL_ID) != BC_EMU_RTL_ID) throwRuntime("BC_EMU isn't loaded!");
+
+    // Determine the major/minor version of the RTL build
+    uint32_t rtl_version = (reg_read(REG_RTL_MAJOR) << 16) | reg_read(REG_RTL_MINOR);
+
+    // If we don't have the correct version of the BC_EMU RTL, complain
+    if (rtl_version < 0x10018) throwRuntime("BC_EMU version 1.24 or greater required");
+
+    // If this becomes non-zero, we abort
+    reg_write(REG_ABORT, 0);
+
+    // So far, we've completed no bright-cycles
+    bc_count_ = 0;
+    reg_write(REG_BC_COUNT, bc_count_);
+
+    // Ensure that the RTL is not alreay sending packets
+    // from some previous instantiation
+    next_abort_poll_ = chrono::steady_clock::now();
+    reg_write(REG_FIFO_SELECT, 0);
+    wait_for_register(REG_FIFO_SELECT, 0, 1000, "fifo_select to clear");
+
+    // From here on, FIFO switches are waited for on the device's interrupt if we can
+    start_interrupt_wait();
+
+    // Use the pacing profile for this card
+    if (use_profile) load_device_profile();
+
+    note_startup_phase("check RTL", start_time);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// note_startup_phase() - Records a startup phase for the startup report
+//=================================================================================================
+void Feeder::note_startup_phase(const char* name, chrono::steady_clock::time_point start,
+                                chrono::steady_clock::time_point end, bool background)
+{
+    startup_phases_.push_back({name, start, end, background});
+
+    // A phase that ran in the background put itself in the timeline, on its own thread
+    if (!background)
+    {
+        span_trace_.span(name, "startup", chrono::nanoseconds(start.time_since_epoch()).count(),
+                         chrono::nanoseconds(end.time_since_epoch()).count());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start_span_trace() - Starts recording the timeline, if there's a file to write it to.  Startup
+//                      phases that finished before now are put into it
+//=================================================================================================
+void Feeder::start_span_trace()
+{
+    if (config.trace_file.empty() || span_trace_.enabled()) return;
+
+    span_trace_.start(config.trace_capacity);
+    span_trace_.name_thread("feeder");
+    for (auto& phase : startup_phases_)
+    {
+        span_trace_.span(phase.name, "startup", chrono::nanoseconds(phase.start.time_since_epoch()).count(),
+                         chrono::nanoseconds(phase.end.time_since_epoch()).count());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// show_startup_report() - Shows when each startup phase ran, relative to the first of them.
+//                         Adding up the phases shows how long startup would take if nothing
+//                         overlapped
+//=================================================================================================
+void Feeder::show_startup_report()
+{
+    if (startup_phases_.empty()) return;
+
+    auto first = startup_phases_[0].start, last = startup_phases_[0].end;
+    double serial_ms = 0;
+    for (auto& phase : startup_phases_)
+    {
+        first = min(first, phase.start);
+        last  = max(last,  phase.end);
+        serial_ms += chrono::duration<double, milli>(phase.end - phase.start).count();
+    }
+
+    sort
+    (
+        startup_phases_.begin(), startup_phases_.end(),
+        [](const startup_phase_t& a, const startup_phase_t& b) {return a.start < b.start;}
+    );
+
+    auto ms = [&](chrono::steady_clock::time_point t) {return chrono::duration<double, milli>(t - first).count();};
+
+    printf("Startup phases:\n");
+    for (auto& phase : startup_phases_)
+    {
+        printf
+        (
+            "  %-20s %9.3f - %9.3f ms (%9.3f ms)%s\n", phase.name, ms(phase.start), ms(phase.end),
+            ms(phase.end) - ms(phase.start), phase.background ? " in parallel" : ""
+        );
+    }
+    printf("Startup took %.3f ms (%.3f ms if run one after another)\n", ms(last), serial_ms);
+
+    startup_phases_.clear();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// close() - Flushes any register trace to disk and unmaps the device
+//=================================================================================================
+void Feeder::close()
+{
+    // Write the timeline.  Recording carries on, in case the device is opened again
+    if (span_trace_.enabled())
+    {
+        size_t count = span_trace_.write(config.trace_file);
+        if (config.verbose) printf("Wrote %zu spans to %s\n", count, config.trace_file.c_str());
+    }
+
+    stop_interrupt_wait();
+    reg_trace_.stop();
+    watcher_.stop();
+    stop_source();
+    device_.close();
+    mmio_regs_.detach();
+    traced_regs_.detach();
+    counting_regs_.detach();
+    memory_regs_.detach();
+    memory_regs_.storage.clear();
+    reg_access_ = ACCESS_MMIO;
+    fifos_reset_ = false;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// profile_filename() - Returns the name of the pacing profile for the open device and the
+//                      version of the RTL that it's running
+//=================================================================================================
+string Feeder::profile_filename()
+{
+    char name[100];
+    uint32_t major = reg_read(REG_RTL_MAJOR);
+    uint32_t minor = reg_read(REG_RTL_MINOR);
+    sprintf(name, "%s_rtl_%u.%u.conf", device_.bdf().c_str(), major, minor);
+    return config.profile_dir + "/" + name;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// load_device_profile() - If a pacing profile exists for this device and RTL version, use the
+//                         pacing settings it contains
+//=================================================================================================
+void Feeder::load_device_profile()
+{
+    CConfigFile cf;
+    string filename = profile_filename();
+
+    // If there's no profile for this device, use the configured pacing
+    if (!cf.read(filename, false)) return;
+
+    cf.get("word_delay_us", &config.word_delay_us);
+    cf.get("burst_size",    &config.burst_size   );
+    if (config.burst_size == 0) throwRuntime("%s: burst_size must be non-zero", filename.c_str());
+
+    // In verbose mode, tell the user which pacing we're using
+    if (config.verbose)
+    {
+        printf("Using %s: word_delay_us = %u, burst_size = %u\n",
+               filename.c_str(), config.word_delay_us, config.burst_size);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// request_abort() - Asks a running job to stop.  This only stores the request, so it's safe to
+//                   call from any thread or from a signal handler
+//=================================================================================================
+void Feeder::request_abort(const char* source)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    abort_request_ns_.store(now.tv_sec * 1000000000LL + now.tv_nsec, memory_order_relaxed);
+    abort_request_.store(source, memory_order_release);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// abort_job() - Records where an abort request came from and throws job_aborted
+//=================================================================================================
+void Feeder::abort_job(const char* source, chrono::steady_clock::time_point request_time)
+{
+    // The request is consumed here, so an abort while loading frames doesn't carry over into
+    // the next job
+    abort_request_ = nullptr;
+    abort_source_ = source;
+
+    // The span runs from the request to the moment we noticed it
+    span_trace_.span(source, "control", chrono::nanoseconds(request_time.time_since_epoch()).count(),
+                     SpanTrace::now_ns());
+    abort_request_time_ = request_time;
+    throw job_aborted();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// check_abort() - Throws job_aborted if an abort has been requested via request_abort(), the
+//                 abort register, or the control channel.
+//
+// A call to request_abort() is noticed on every call.  The abort register and the control
+// channel are polled twice per "abort_latency_us", or on every call if "force" is true.  Call
+// this at least every few microseconds while the job is running
+//=================================================================================================
+void Feeder::check_abort(bool force)
+{
+    char message[64];
+
+    // If someone called request_abort(), abort
+    check_abort_request();
+
+    // If it's not yet time to poll, we're done
+    auto now = chrono::steady_clock::now();
+    if (!force && now < next_abort_poll_) return;
+
+    // The request (if there is one) arrived sometime since the last poll
+    auto last_poll = next_abort_poll_ - chrono::microseconds(config.abort_latency_us / 2);
+    next_abort_poll_ = now + chrono::microseconds(config.abort_latency_us / 2);
+
+    // If another process asked us to abort via the abort register, do so
+    if (reg_base() && reg_read(REG_ABORT)) abort_job("reg_abort", last_poll);
+
+    // If we were sent an "abort" message over the control channel, abort
+    if (control_socket_ >= 0)
+    {
+        int length = recv(control_socket_, message, sizeof(message) - 1, MSG_DONTWAIT);
+        if (length > 0)
+        {
+            message[length] = 0;
+            if (strncmp(message, "abort", 5) == 0) abort_job("control channel", last_poll);
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// check_abort_request() - Throws job_aborted if request_abort() has been called.  This doesn't
+//                         touch the device, so it's safe on a thread that prepares frames while
+//                         another opens the device
+//=================================================================================================
+void Feeder::check_abort_request()
+{
+    const char* source = abort_request_.load(memory_order_acquire);
+    if (source)
+    {
+        auto since_epoch = chrono::nanoseconds(abort_request_ns_.load(memory_order_relaxed));
+        auto request_time = chrono::steady_clock::time_point
+        (
+            chrono::duration_cast<chrono::steady_clock::duration>(since_epoch)
+        );
+        abort_job(source, request_time);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// wait_for_register() - Waits for a register to have the specified value
+//
+// Passed: reg       = The register to poll
+//         value     = The value we're waiting for
+//         poll_us   = Microseconds between polls
+//         what      = A description of what we're waiting for
+//         abortable = If true, abort requests are honored while we wait
+//
+// Throws: job_aborted if an abort is requested, or runtime_error if the wait lasts longer than
+//         "wait_timeout_ms"
+//=================================================================================================
+void Feeder::wait_for_register
+(
+    reg_id_t           reg,
+    uint32_t           value,
+    uint32_t           poll_us,
+    const char*        what,
+    bool               abortable,
+    bool               interrupt
+)
+{
+    auto start_time = chrono::steady_clock::now();
+
+    // We have to poll often enough to honor the abort latency
+    poll_us = min(poll_us, max(config.abort_latency_us / 2, 1u));
+
+    // If the RTL interrupts us when this happens, we sleep until it does, waking only to check
+    // for an abort
+    if (interrupt && irq_epoll_ < 0) interrupt = false;
+
+    while (reg_read(reg) != value)
+    {
+        if (abortable) check_abort();
+
+        // If we've been waiting too long, complain
+        if (config.wait_timeout_ms)
+        {
+            auto elapsed = chrono::steady_clock::now() - start_time;
+            if (elapsed > chrono::milliseconds(config.wait_timeout_ms))
+            {
+                throwRuntime("Timed out waiting for %s", what);
+            }
+        }
+
+        if (interrupt)
+            wait_for_interrupt(max(config.abort_latency_us / 2, 1u));
+        else
+            usleep(poll_us);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// wait_for_slot() - Waits until the slot for the next FIFO hand-off.  We sleep (on the absolute
+//                   CLOCK_MONOTONIC timeline, so a late wake-up doesn't push the slots back)
+//                   until just before the slot, waking to check for an abort, and spin out the
+//                   rest of the wait
+//=================================================================================================
+void Feeder::wait_for_slot()
+{
+    int64_t now = SpanTrace::now_ns(), slot, wake;
+    {
+        lock_guard<mutex> lock(stats_mutex_);
+        slot = cadence_.next_slot(now);
+        wake = cadence_.wake_time(slot);
+    }
+    int64_t hold_ns = now;
+
+    // We have to wake often enough to honor the abort latency
+    const int64_t max_sleep_ns = max(config.abort_latency_us / 2, 1u) * 1000LL;
+
+    while (now < wake)
+    {
+        check_abort();
+        int64_t until = min(wake, now + max_sleep_ns);
+        timespec ts = {(time_t)(until / 1000000000), (long)(until % 1000000000)};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        now = SpanTrace::now_ns();
+
+        // Learn how late a sleep all the way to the wake-up time ends
+        if (until == wake)
+        {
+            lock_guard<mutex> lock(stats_mutex_);
+            cadence_.woke(wake, now);
+        }
+    }
+
+    // Spin out the rest of the wait.  That's usually microseconds, but it can be as long as the
+    // wake-up bias, so keep watching for an abort
+    while (now < slot)
+    {
+        check_abort();
+        now = SpanTrace::now_ns();
+    }
+
+    if (span_trace_.enabled()) span_trace_.span("hold for slot", "fifo", hold_ns, now);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start_interrupt_wait() - If the device's interrupts are available (and we're configured to
+//                          use them), creates the epoll set that wait_for_interrupt() sleeps in.
+//                          The control socket is in it too, so that an abort message wakes us
+//=================================================================================================
+void Feeder::start_interrupt_wait()
+{
+    stop_interrupt_wait();
+
+    int irq_fd = device_.interruptFd();
+    if (!config.interrupts || irq_fd < 0)
+    {
+        if (config.verbose) printf("Polling %s (%s) for FIFO switches\n", device_.bdf().c_str(),
+                                   PciDevice::accessName(device_.access()));
+        return;
+    }
+
+    irq_epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    if (irq_epoll_ < 0) throwRuntime("epoll_create1 failed");
+
+    for (int fd : {irq_fd, control_socket_})
+    {
+        if (fd < 0) continue;
+        epoll_event event = {};
+        event.events  = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(irq_epoll_, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            stop_interrupt_wait();
+            throwRuntime("Can't wait on the interrupts of %s", device_.bdf().c_str());
+        }
+    }
+
+    if (config.verbose) printf("Waiting on interrupts from %s (%s) for FIFO switches\n",
+                               device_.bdf().c_str(), PciDevice::accessName(device_.access()));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop_interrupt_wait() - Closes the epoll set, if there is one
+//=================================================================================================
+void Feeder::stop_interrupt_wait()
+{
+    if (irq_epoll_ >= 0) ::close(irq_epoll_);
+    irq_epoll_ = -1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// wait_for_interrupt() - Sleeps until the device interrupts us, a message arrives on the
+//                        control socket, or "timeout_us" passes.  An interrupt is consumed and
+//                        re-enabled; the caller finds out what happened by reading registers
+//=================================================================================================
+void Feeder::wait_for_interrupt(uint32_t timeout_us)
+{
+    epoll_event event[2];
+
+    int count = epoll_wait(irq_epoll_, event, 2, (timeout_us + 999) / 1000);
+
+    for (int i = 0; i < count; ++i)
+    {
+        // A message on the control socket is read by check_abort(), so make it look now
+        if (event[i].data.fd == control_socket_)
+            next_abort_poll_ = chrono::steady_clock::now();
+        else
+            device_.acknowledgeInterrupt();
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// This returns a list containing the name of every .csv file in the specified directory, and if
+// "binary" is true, every .bin and .npy file too.  The returned list is sorted alphabetically
+//=================================================================================================
+static vector<string> get_file_list_from_directory(std::string directory, bool binary)
+{
+    vector<string> result;
+
+    for (const auto & entry : fs::directory_iterator(directory))
+    {
+        // Get the extension of this directory entry
+        auto extent = entry.path().extension();
+
+        // If this is a frame-data file, add it to the result list
+        bool wanted = (extent == ".csv") || (binary && (extent == ".bin" || extent == ".npy"));
+        if (fs::is_regular_file(entry.status()) && wanted)
+        {
+            result.push_back(entry.path());
+        }
+    }
+
+    // Sort the result list
+    std::sort(result.begin(), result.end());
+
+    // Hand the resulting, sorted list to the caller
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// load_dataset() - Determines which frame-data files to use, and reads them
+//=================================================================================================
+void Feeder::load_dataset()
+{
+    // If the previous dataset is still loading, stop it.  Whatever the FIFOs hold came from it
+    finish_loading(true);
+    stop_source();
+    forget_resident_frames();
+    load_start_time_ = chrono::steady_clock::now();
+
+    // If the dataset in use came from a frame pack, its frames point into the mapping
+    if (frame_pack_.is_open())
+    {
+        frame_.clear();
+        frame_pack_.close();
+    }
+
+    // A frame pack only has to be mapped, so it's never cached either
+    if (!config.frame_pack.empty())
+    {
+        if (!config.patch_file.empty()) throwRuntime("A patch file and a frame pack can't be used together");
+        dataset_cached_ = false;
+        dataset_key_.clear();
+        read_frame_pack();
+        return;
+    }
+
+    // A patch dataset is small enough to read every time, so it's never cached
+    if (!config.patch_file.empty())
+    {
+        dataset_cached_ = false;
+        dataset_key_.clear();
+        read_patch_dataset();
+        return;
+    }
+
+    // If the dataset in use came from a patch file, its frames point into it
+    if (!patch_data_.frame.empty())
+    {
+        frame_.clear();
+        patch_data_ = patch_dataset_t();
+    }
+
+    // In watch mode, start watching before we list the directory, so that no change can slip
+    // in between the two
+    if (config.watch)
+    {
+        if (config.dir.empty()) throwRuntime("Watch mode requires a dataset directory");
+        const vector<string> extensions = {".csv", ".bin", ".npy"};
+        watcher_.start(config.dir, extensions, [this](file_change_t& change) {load_changed_file(change);});
+    }
+
+    // If the user gave us a directory name, fetch the filenames from it
+    dir_scan_start_ = dir_scan_end_ = {};
+    if (!config.dir.empty())
+    {
+        TraceScope span(span_trace_, "scan directory", "loader");
+        dir_scan_start_ = chrono::steady_clock::now();
+        auto v = get_file_list_from_directory(config.dir, true);
+        config.data_files = v;
+        dir_scan_end_ = chrono::steady_clock::now();
+    }
+
+    // If the user hasn't specified any data files, complain
+    if (config.data_files.empty()) throwRuntime("No data-files specified");
+
+    // In watch mode, or with no cache, the files are always read
+    dataset_cached_ = false;
+    if (config.watch || config.dataset_cache == 0)
+    {
+        dataset_key_.clear();
+        read_frame_data_files();
+        return;
+    }
+
+    // A dataset is identified by the files it's read from, and is only still good if none of
+    // them has changed size or been modified since
+    string key, stamp;
+    for (auto& filename : config.data_files)
+    {
+        struct stat sb;
+        if (stat(filename.c_str(), &sb) < 0) throwRuntime("Can't stat %s", filename.c_str());
+        key   += filename + '\n';
+        stamp += to_string(sb.st_size) + ' ' + to_string(sb.st_mtim.tv_sec) + '.'
+               + to_string(sb.st_mtim.tv_nsec) + '\n';
+    }
+
+    // Use the copy in memory if we have one, otherwise read and parse the frame-data files
+    dataset_cached_ = take_cached_dataset(key, stamp);
+    if (dataset_cached_)
+    {
+        if (config.verbose) printf("Using the %lu frames already in memory\n", frame_.size());
+    }
+    else read_frame_data_files();
+
+    dataset_key_   = key;
+    dataset_stamp_ = stamp;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// take_cached_dataset() - Puts the dataset in use into the cache, and the dataset identified by
+//                         "key" (if the cache holds an up-to-date copy of it) into use
+//
+// Returns: true if the requested dataset is now in use
+//=================================================================================================
+bool Feeder::take_cached_dataset(const string& key, const string& stamp)
+{
+    // If the dataset is already in use, there's nothing to do
+    if (key == dataset_key_ && stamp == dataset_stamp_) return true;
+
+    // Put the dataset in use into the cache.  A dataset whose files have changed is useless
+    if (!dataset_key_.empty() && key != dataset_key_)
+    {
+        auto& entry = dataset_cache_[dataset_key_];
+        entry.reset(new cached_dataset_t);
+        entry->stamp = dataset_stamp_;
+        entry->last_used = dataset_loads_;
+        swap_dataset(*entry);
+    }
+    dataset_key_.clear();
+    ++dataset_loads_;
+
+    // Find the one we want.  If it's out of date, it's discarded
+    bool found = false;
+    auto it = dataset_cache_.find(key);
+    if (it != dataset_cache_.end())
+    {
+        found = (it->second->stamp == stamp);
+        if (found) swap_dataset(*it->second);
+        dataset_cache_.erase(it);
+    }
+
+    // The cache holds what's left of "dataset_cache" once the dataset in use is counted.  The
+    // least recently used datasets are dropped
+    while (!dataset_cache_.empty() && dataset_cache_.size() >= config.dataset_cache)
+    {
+        auto oldest = dataset_cache_.begin();
+        for (auto it = dataset_cache_.begin(); it != dataset_cache_.end(); ++it)
+        {
+            if (it->second->last_used < oldest->second->last_used) oldest = it;
+        }
+        dataset_cache_.erase(oldest);
+    }
+
+    return found;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// swap_dataset() - Exchanges the dataset in use with a cached one.  The frame-data itself never
+//                  moves, so every bce_frame_t remains valid
+//=================================================================================================
+void Feeder::swap_dataset(cached_dataset_t& other)
+{
+    frame_.swap(other.frame);
+    frame_data_.swap(other.data);
+    frame_map_.swap(other.map);
+    frame_name_.swap(other.name);
+    frame_crc_.swap(other.crc);
+    frame_store_.swap(other.store);
+    forget_resident_frames();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_frame() - Reads a frame-data file into a vector.  The rows of a CSV file are laid out
+//                as config.columns says
+//=================================================================================================
+intvec_t Feeder::read_frame(const string& filename)
+{
+    if (config.columns.empty() || is_binary_frame_file(filename))
+    {
+        return read_frame_file(filename, config.read_method);
+    }
+
+    size_t   columns;
+    intvec_t result = read_csv_file(filename, config.read_method, &columns);
+    try
+    {
+        config.columns.apply(result, columns);
+    }
+    catch(const runtime_error& e)
+    {
+        throwRuntime("%s: %s", filename.c_str(), e.what());
+    }
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// This reads in all of the files specified by config.data_files.  Each file is parsed into a
+// vector of integers, and that vector becomes one frame
+//=================================================================================================
+void Feeder::read_frame_data_files()
+{
+    // Frames can only be read in the background if the dataset doesn't change under us
+    if (config.progressive_load && !config.watch)
+    {
+        start_loading();
+        return;
+    }
+
+    frame_data_.clear();
+    frame_map_.clear();
+
+    // Binary files are sent straight from the page cache, unless their words have to be
+    // transformed, or the dataset can change under us
+    bool map_binary = config.transform.empty() && !config.watch;
+    if (map_binary) frame_map_.resize(config.data_files.size());
+
+    for (auto filename : config.data_files)
+    {
+        // This might be running alongside start_up(), so it leaves the device alone
+        check_abort_request();
+
+        // In verbose mode, tell the user what we're doing
+        if (config.verbose) printf("Reading %s\n", filename.c_str());
+
+        // Map the file, or read it using whichever method is configured
+        size_t index = frame_data_.size();
+        TraceScope span(span_trace_, "read frame", "loader", "frame", index);
+        if (map_binary && is_binary_frame_file(filename))
+        {
+            frame_map_[index].map(filename);
+            frame_data_.emplace_back();
+        }
+        else frame_data_.push_back(read_frame(filename));
+    }
+
+    // Apply the configured transforms to every frame
+    if (!config.transform.empty())
+    {
+        auto start_time = chrono::steady_clock::now();
+        TraceScope span(span_trace_, "transform", "loader");
+        config.transform.apply(frame_data_);
+        auto end_time = chrono::steady_clock::now();
+
+        if (config.verbose)
+        {
+            auto duration = chrono::duration_cast<chrono::microseconds>(end_time - start_time);
+            printf("Transformed %lu frames in %li us\n", frame_data_.size(), duration.count());
+        }
+    }
+
+    // Every frame we send is one of the vectors we just read, or one of the files we mapped
+    frame_.clear();
+    for (size_t index=0; index<frame_data_.size(); ++index)
+    {
+        if (frame_is_mapped(index))
+            frame_.push_back({frame_map_[index].data(), frame_map_[index].size()});
+        else
+            frame_.push_back({frame_data_[index].data(), frame_data_[index].size()});
+    }
+    frame_name_ = config.data_files;
+
+    // Move the frames next to the card, into huge pages.  In watch mode frames come and go,
+    // so they stay where they are
+    if (!config.watch && (config.huge_pages || numa_node_ >= 0)) pack_frame_store();
+
+    // Compute the CRC of every frame, and make sure they're what we expect
+    compute_frame_crcs();
+    if (!config.crc_manifest.empty()) check_crc_manifest();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_patch_dataset() - Reads the dataset described by config.patch_file.  Every frame points
+//                        at its base frame, and its patches are applied as it's loaded into a
+//                        FIFO
+//=================================================================================================
+void Feeder::read_patch_dataset()
+{
+    // Patches are applied to the words as they're sent, so they can't be combined with
+    // transforms, and the frames can't change under us
+    if (config.watch) throwRuntime("Watch mode can't be used with a patch file");
+    if (!config.transform.empty()) throwRuntime("Transforms can't be applied to a patch file");
+
+    if (config.verbose) printf("Reading %s\n", config.patch_file.c_str());
+
+    {
+        TraceScope span(span_trace_, "read frame", "loader");
+        patch_data_ = read_patch_file(config.patch_file, config.read_method);
+    }
+
+    // Every frame we send is a base frame, with its patches written in as it's sent
+    frame_data_.clear();
+    frame_map_.clear();
+    frame_.clear();
+    frame_name_.clear();
+    for (size_t index=0; index<patch_data_.frame.size(); ++index)
+    {
+        auto& base = patch_data_.base[patch_data_.frame[index].base];
+        frame_.push_back({base.data(), base.size()});
+        frame_name_.push_back("frame_" + to_string(index));
+    }
+
+    // The CRC of each frame is of the words that are actually sent
+    {
+        TraceScope span(span_trace_, "compute CRCs", "loader");
+        frame_crc_.resize(frame_.size());
+        for (size_t index=0; index<frame_.size(); ++index)
+        {
+            frame_crc_[index] = patched_frame_crc(patch_data_, index);
+        }
+    }
+
+    // A manifest lists data-files, and these frames aren't data-files
+    if (!config.crc_manifest.empty())
+    {
+        fprintf(stderr, "Warning: the CRC manifest isn't checked for a patch file\n");
+    }
+
+    // In verbose mode, show how much memory this saves
+    if (config.verbose)
+    {
+        size_t full = 0;
+        for (auto& frame : frame_) full += frame.size * sizeof(uint32_t);
+        printf("%lu frames from %lu base frames and %lu patches: %lu bytes instead of %lu\n",
+               frame_.size(), patch_data_.base.size(), patch_data_.patch.size(),
+               patch_data_.bytes(), full);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_frame_pack() - Maps the frame pack named by config.frame_pack.  Every frame is sent from
+//                     where it lies in the mapping, so nothing is read from disk until it's sent
+//=================================================================================================
+void Feeder::read_frame_pack()
+{
+    // The frames in a pack can't change under us, and were transformed when it was built
+    if (config.watch) throwRuntime("Watch mode can't be used with a frame pack");
+    if (!config.transform.empty())
+    {
+        fprintf(stderr, "Warning: transforms are applied when a frame pack is built, not when it's sent\n");
+    }
+
+    if (config.verbose) printf("Opening %s\n", config.frame_pack.c_str());
+
+    {
+        TraceScope span(span_trace_, "open frame pack", "loader");
+        frame_pack_.open(config.frame_pack);
+    }
+    if (frame_pack_.size() == 0) throwRuntime("%s contains no frames", config.frame_pack.c_str());
+
+    // The index holds the CRC of every frame, so the frames themselves aren't touched
+    size_t count = frame_pack_.size();
+    frame_data_.clear();
+    frame_map_.clear();
+    frame_store_.release();
+    frame_.resize(count);
+    frame_crc_.resize(count);
+    frame_name_.resize(count);
+    for (size_t index=0; index<count; ++index)
+    {
+        frame_[index]      = frame_pack_.frame(index);
+        frame_crc_[index]  = frame_pack_.crc(index);
+        frame_name_[index] = frame_pack_.name(index);
+    }
+
+    // The names in a pack are the names of the files it was built from
+    if (!config.crc_manifest.empty()) check_crc_manifest();
+
+    if (config.verbose) printf("%lu frames in %s, read from disk as they're sent\n", count, config.frame_pack.c_str());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// write_frame_pack() - Builds a frame pack from the files named by config.dir or
+//                      config.data_files.  Files are read a batch at a time on every CPU, and
+//                      written to the pack in order
+//
+// Returns: the number of frames in the pack
+//=================================================================================================
+size_t Feeder::write_frame_pack(string filename)
+{
+    const size_t BATCH_SIZE = 1024;
+
+    // The files are listed just as load_dataset() lists them
+    vector<string> files = config.data_files;
+    if (!config.dir.empty()) files = get_file_list_from_directory(config.dir, true);
+    if (files.empty()) throwRuntime("No data-files specified");
+
+    auto start_time = chrono::steady_clock::now();
+    FramePackWriter pack;
+    pack.create(filename);
+
+    vector<intvec_t> batch;
+    for (size_t first = 0; first < files.size(); first += BATCH_SIZE)
+    {
+        check_abort_request();
+
+        // Read this batch of files, laid out and transformed just as a job would have them
+        batch.resize(min(BATCH_SIZE, files.size() - first));
+        parallel_for(batch.size(), [&](size_t i)
+        {
+            batch[i] = read_frame(files[first + i]);
+            config.transform.apply(batch[i], first + i);
+        });
+
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            string name = fs::path(files[first + i]).filename().string();
+            pack.add(batch[i].data(), batch[i].size(), name);
+        }
+
+        if (config.verbose) printf("Packed %lu of %lu files\r", first + batch.size(), files.size());
+    }
+
+    uint64_t bytes = pack.finish();
+
+    if (config.verbose)
+    {
+        auto duration = chrono::duration<double>(chrono::steady_clock::now() - start_time);
+        printf("\nWrote %lu frames (%lu bytes) to %s in %.3f s\n",
+               files.size(), bytes, filename.c_str(), duration.count());
+    }
+
+    return files.size();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// pack_frame_store() - Copies every frame into a single block on the card's NUMA node, made of
+//                      huge pages if there are any.  The vectors the frames were read into are
+//                      then freed
+//=================================================================================================
+void Feeder::pack_frame_store()
+{
+    auto start_time = chrono::steady_clock::now();
+    TraceScope span(span_trace_, "pack frames", "loader");
+
+    // Each frame starts on a cache-line
+    auto padded = [](size_t words) {return (words + 15) & ~(size_t)15;};
+
+    // Mapped files are sent from where they lie, so only the frames we read are packed
+    size_t total = 0;
+    for (size_t index=0; index<frame_.size(); ++index)
+    {
+        if (!frame_is_mapped(index)) total += padded(frame_[index].size);
+    }
+    if (total == 0) return;
+
+    uint32_t* p = frame_store_.allocate(total, numa_node_, config.huge_pages);
+    for (size_t index=0; index<frame_.size(); ++index)
+    {
+        if (frame_is_mapped(index)) continue;
+        auto& frame = frame_[index];
+        memcpy(p, frame.data, frame.size * sizeof(uint32_t));
+        frame.data = p;
+        p += padded(frame.size);
+    }
+    frame_data_.clear();
+    forget_resident_frames();
+
+    if (config.verbose)
+    {
+        auto duration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start_time);
+        printf("Frame-data: %s, packed in %li us\n", frame_store_.placement().c_str(), duration.count());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// place_on_device_node() - Pins this thread to the CPUs of the card's NUMA node, and prefers
+//                          that node's memory.  Threads we start later inherit both
+//=================================================================================================
+void Feeder::place_on_device_node()
+{
+    numa_node_ = device_.numaNode();
+
+    // On a single-node machine, sysfs doesn't name a node
+    if (numa_node_ < 0)
+    {
+        if (config.verbose) printf("%s doesn't report a NUMA node\n", device_.bdf().c_str());
+        return;
+    }
+
+    if (!config.numa)
+    {
+        if (config.verbose) printf("%s is on NUMA node %i (not pinned)\n", device_.bdf().c_str(), numa_node_);
+        return;
+    }
+
+    // Failing to pin costs performance, not correctness, so it's only a warning
+    try
+    {
+        string cpus = pin_to_numa_node(numa_node_);
+        if (config.verbose)
+        {
+            printf("%s is on NUMA node %i: feeder pinned to CPUs %s\n",
+                   device_.bdf().c_str(), numa_node_, cpus.c_str());
+        }
+    }
+    catch(const exception& e)
+    {
+        fprintf(stderr, "Warning: %s\n", e.what());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// set_frames() - Sends frames straight from caller memory.  Only the list of frames is copied,
+//                never the frame-data itself
+//=================================================================================================
+void Feeder::set_frames(const bce_frame_t* frames, size_t count)
+{
+    char name[32];
+
+    // These frames don't come from files, so they're never cached
+    finish_loading(true);
+    stop_source();
+    forget_resident_frames();
+    dataset_key_.clear();
+    frame_data_.clear();
+    frame_map_.clear();
+    patch_data_ = patch_dataset_t();
+    frame_.assign(frames, frames + count);
+    frame_pack_.close();
+
+    frame_name_.clear();
+    for (size_t index=0; index<count; ++index)
+    {
+        sprintf(name, "frame_%zu", index);
+        frame_name_.push_back(name);
+    }
+
+    compute_frame_crcs();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// listen() - Arranges for frames to come from producers that connect to a unix-domain socket
+//=================================================================================================
+void Feeder::listen(string path)
+{
+    stop_source();
+    if (!socket_source_) socket_source_.reset(new SocketSource);
+    socket_source_->start(path, config.queue_depth, config.max_repeats);
+    set_source(socket_source_.get());
+
+    if (config.verbose) printf("Listening for frames on %s\n", path.c_str());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create_ring() - Arranges for frames to come from a producer that writes them into a
+//                 shared-memory ring
+//=================================================================================================
+void Feeder::create_ring(string name)
+{
+    stop_source();
+    if (!shm_source_) shm_source_.reset(new ShmSource);
+    shm_source_->start(name, config.shm_slots, config.shm_slot_words, config.max_repeats);
+    set_source(shm_source_.get());
+
+    if (config.verbose)
+    {
+        printf("Taking frames from shared memory %s (%u slots of %u words)\n",
+               name.c_str(), config.shm_slots, config.shm_slot_words);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop_source() - Stops taking frames from a socket or a shared-memory ring
+//=================================================================================================
+void Feeder::stop_source()
+{
+    set_source(nullptr);
+    if (socket_source_) socket_source_->stop();
+    if (shm_source_) shm_source_->stop();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// compute_frame_crcs() - Computes the CRC32C of every frame
+//=================================================================================================
+void Feeder::compute_frame_crcs()
+{
+    auto start_time = chrono::steady_clock::now();
+    TraceScope span(span_trace_, "compute CRCs", "loader");
+
+    frame_crc_.resize(frame_.size());
+    parallel_for(frame_.size(), [this](size_t index)
+    {
+        auto& frame = frame_[index];
+        frame_crc_[index] = crc32c(frame.data, frame.size * sizeof(uint32_t));
+    });
+
+    auto end_time = chrono::steady_clock::now();
+
+    if (config.verbose)
+    {
+        auto duration = chrono::duration_cast<chrono::microseconds>(end_time - start_time);
+        printf("Computed %s CRC32C of %lu frames in %li us\n",
+               crc32c_implementation(), frame_.size(), duration.count());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_crc_manifest() - Reads a manifest of expected CRCs.  Each line of the manifest is
+//                       "<crc> <filename>"
+//
+// Returns: a map of filename (without the directory) to CRC
+//=================================================================================================
+static map<string, uint32_t> read_crc_manifest(const char* manifest)
+{
+    char          line[1000], name[1000];
+    unsigned long long crc;
+    map<string, uint32_t> expected;
+
+    FILE* ifile = fopen(manifest, "r");
+    if (ifile == nullptr) throwRuntime("can't read %s", manifest);
+    while (fgets(line, sizeof line, ifile))
+    {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%llx %999s", &crc, name) != 2) continue;
+        if (crc > 0xFFFFFFFF)
+        {
+            fclose(ifile);
+            throwRuntime("Invalid CRC for %s in %s", name, manifest);
+        }
+        expected[name] = crc;
+    }
+    fclose(ifile);
+
+    return expected;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// check_frame_crc() - Compares the CRC of a frame against the CRC listed for its file in a
+//                     manifest.  Files are matched by name, ignoring the directory
+//=================================================================================================
+static void check_frame_crc(const map<string, uint32_t>& expected, const char* manifest,
+                            const string& filename, uint32_t crc)
+{
+    string name = fs::path(filename).filename().string();
+    auto   it = expected.find(name);
+    if (it == expected.end())
+    {
+        fprintf(stderr, "Warning: %s isn't listed in %s\n", name.c_str(), manifest);
+        return;
+    }
+
+    if (it->second != crc)
+    {
+        throwRuntime
+        (
+            "CRC mismatch on %s: expected 0x%08X, found 0x%08X",
+            filename.c_str(), it->second, crc
+        );
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// check_crc_manifest() - Compares the CRC of every frame against the CRC listed for its file in
+//                        the manifest
+//=================================================================================================
+void Feeder::check_crc_manifest()
+{
+    const char* manifest = config.crc_manifest.c_str();
+    auto expected = read_crc_manifest(manifest);
+
+    for (size_t index=0; index<frame_name_.size(); ++index)
+    {
+        check_frame_crc(expected, manifest, frame_name_[index], frame_crc_[index]);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start_loading() - Starts reading the frame-data files on background threads.  Frames are
+//                   claimed in order, so the first frames are ready first.  As each frame is
+//                   ready, it's transformed, its CRC is computed and checked, and it's marked
+//                   ready for the feeder
+//=================================================================================================
+void Feeder::start_loading()
+{
+    size_t count = config.data_files.size();
+
+    // Make room for every frame up front, so nothing moves while the loader fills them in.
+    // The job might already be sending them, so they're only packed into a FrameStore once
+    // the loader has finished and no job is running (see finish_loading())
+    frame_store_.release();
+    frame_map_.clear();
+    frame_map_.resize(count);
+    frame_data_.assign(count, intvec_t());
+    frame_.assign(count, bce_frame_t{nullptr, 0});
+    frame_crc_.assign(count, 0);
+    frame_name_ = config.data_files;
+
+    frame_ready_.reset(new atomic<bool>[count]);
+    for (size_t index = 0; index < count; ++index) frame_ready_[index] = false;
+    next_load_index_ = 0;
+    frames_loaded_   = 0;
+    loader_stop_     = false;
+    loader_error_    = nullptr;
+    loader_failed_index_ = SIZE_MAX;
+    loader_waits_    = 0;
+
+    // Every thread needs the manifest, so it's read once, here
+    auto manifest = make_shared<map<string, uint32_t>>();
+    if (!config.crc_manifest.empty()) *manifest = read_crc_manifest(config.crc_manifest.c_str());
+
+    auto start_time = load_start_time_;
+    size_t progress_step = max(count / 10, (size_t)1);
+    auto worker = [this, manifest, count, start_time, progress_step]()
+    {
+        span_trace_.name_thread("loader");
+
+        size_t index;
+        while (!loader_stop_ && (index = next_load_index_++) < count)
+        {
+            TraceScope span(span_trace_, "read frame", "loader", "frame", index);
+            try
+            {
+                const string& filename = frame_name_[index];
+
+                // A binary file that needn't be transformed is sent from the page cache
+                if (config.transform.empty() && is_binary_frame_file(filename))
+                {
+                    frame_map_[index].map(filename);
+                    frame_[index] = {frame_map_[index].data(), frame_map_[index].size()};
+                }
+                else
+                {
+                    intvec_t v = read_frame(filename);
+                    if (!config.transform.empty()) config.transform.apply(v, index);
+                    frame_data_[index] = std::move(v);
+                    frame_[index] = {frame_data_[index].data(), frame_data_[index].size()};
+                }
+
+                auto& frame = frame_[index];
+                frame_crc_[index] = crc32c(frame.data, frame.size * sizeof(uint32_t));
+                if (!config.crc_manifest.empty())
+                {
+                    check_frame_crc(*manifest, config.crc_manifest.c_str(), filename, frame_crc_[index]);
+                }
+            }
+            catch(...)
+            {
+                // Frames are claimed in order, so stopping the claims leaves every frame before
+                // this one to the threads that already claimed it.  The job stops when it
+                // reaches the lowest-numbered frame that failed
+                lock_guard<mutex> lock(loader_mutex_);
+                if (index < loader_failed_index_)
+                {
+                    loader_error_        = current_exception();
+                    loader_failed_index_ = index;
+                }
+                loader_stop_ = true;
+                frame_loaded_.notify_all();
+                return;
+            }
+
+            // Hand the frame to the feeder
+            frame_ready_[index].store(true, memory_order_release);
+            size_t loaded = ++frames_loaded_;
+            lock_guard<mutex> lock(loader_mutex_);
+            frame_loaded_.notify_all();
+
+            // In verbose mode, report progress every tenth of the dataset rather than every file,
+            // from one thread at a time, so that it reads cleanly alongside the job's own output
+            if (config.verbose && (loaded % progress_step == 0 || loaded == count))
+            {
+                auto duration = chrono::steady_clock::now() - start_time;
+                printf("Loaded %lu of %lu frames in the background in %li ms\n", loaded, count,
+                       chrono::duration_cast<chrono::milliseconds>(duration).count());
+            }
+        }
+    };
+
+    // Leave a CPU for the feeder itself
+    size_t thread_count = thread::hardware_concurrency();
+    if (thread_count > 1) --thread_count;
+    if (thread_count > count) thread_count = count;
+    if (thread_count == 0) thread_count = 1;
+    for (size_t i = 0; i < thread_count; ++i) loader_threads_.emplace_back(worker);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// wait_for_frame() - Waits for the loader to finish reading a frame, honoring abort requests as
+//                    we do.  If this frame, or one before it, couldn't be read, the job is
+//                    stopped and the loader's error is thrown
+//=================================================================================================
+void Feeder::wait_for_frame(int index)
+{
+    // This is the usual case: the frame is ready, or there's no loader
+    if (!frame_ready_ || frame_ready_[index].load(memory_order_acquire)) return;
+
+    ++loader_waits_;
+    TraceScope span(span_trace_, "wait for loader", "loader", "frame", index);
+    auto wait = chrono::microseconds(max(config.abort_latency_us / 2, 1u));
+    unique_lock<mutex> lock(loader_mutex_);
+    while (!frame_ready_[index].load(memory_order_acquire))
+    {
+        // A frame that can't be loaded ends the job, just as running out of frames does.  The
+        // frames before it are still coming
+        if (loader_error_ && (size_t)index >= loader_failed_index_)
+        {
+            lock.unlock();
+            stop_job();
+            rethrow_exception(loader_error_);
+        }
+        lock.unlock();
+        check_abort();
+        lock.lock();
+        frame_loaded_.wait_for(lock, wait);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// finish_loading() - Waits for (or with "cancel", stops) the background loader.  A dataset that
+//                    didn't finish loading can't be cached
+//=================================================================================================
+void Feeder::finish_loading(bool cancel)
+{
+    if (cancel) loader_stop_ = true;
+    for (auto& thread : loader_threads_) thread.join();
+    loader_threads_.clear();
+
+    // If there's no loader, there's nothing more to do
+    if (!frame_ready_) return;
+
+    // A loader that finished leaves every frame ready.  Nothing is sending them now, so they
+    // can be moved next to the card, into huge pages, just as read_frame_data_files() does
+    if (frames_loaded_ == frame_.size())
+    {
+        frame_ready_.reset();
+        if (!cancel && !config.watch && (config.huge_pages || numa_node_ >= 0)) pack_frame_store();
+        return;
+    }
+
+    // Otherwise the dataset is incomplete.  If we stopped the loader, nothing can use it
+    dataset_key_.clear();
+    if (!cancel && loader_error_) rethrow_exception(loader_error_);
+    if (cancel)
+    {
+        frame_ready_.reset();
+        frame_.clear();
+        frame_data_.clear();
+        frame_map_.clear();
+        frame_crc_.clear();
+        frame_name_.clear();
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// load_changed_file() - In watch mode, prepares the change to a frame-data file that was
+//                       created, modified or deleted.  This runs on the watcher's thread, so it
+//                       must not touch the frames being sent
+//=================================================================================================
+void Feeder::load_changed_file(file_change_t& change)
+{
+    auto start_time = chrono::steady_clock::now();
+
+    // The file's position in the directory listing is its frame index
+    auto files = get_file_list_from_directory(config.dir, true);
+    auto it    = find(files.begin(), files.end(), change.filename);
+    if (it == files.end())
+    {
+        change.deleted = true;
+        if (config.verbose) printf("Watch: %s was removed\n", change.filename.c_str());
+        return;
+    }
+
+    // Read and transform the file just as read_frame_data_files() would
+    change.data = read_frame(change.filename);
+    if (!config.transform.empty()) config.transform.apply(change.data, it - files.begin());
+    change.crc = crc32c(change.data.data(), change.data.size() * sizeof(uint32_t));
+
+    // If there's a manifest, the new frame must match it
+    if (!config.crc_manifest.empty())
+    {
+        const char* manifest = config.crc_manifest.c_str();
+        check_frame_crc(read_crc_manifest(manifest), manifest, change.filename, change.crc);
+    }
+
+    if (config.verbose)
+    {
+        auto duration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start_time);
+        printf("Watch: re-read %s in %li us\n", change.filename.c_str(), duration.count());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// apply_dataset_changes() - In watch mode, publishes the files the watcher has re-read.  This is
+//                           called between bright-cycles, when no frame is being loaded.  Frames
+//                           that didn't change are neither copied nor re-read
+//=================================================================================================
+void Feeder::apply_dataset_changes()
+{
+    vector<file_change_t> changes;
+    if (!watcher_.take_changes(changes)) return;
+    span_trace_.instant("dataset changed", "control", "files", changes.size());
+
+    for (auto& change : changes)
+    {
+        // Find where this file belongs in the (sorted) dataset
+        auto   it = lower_bound(frame_name_.begin(), frame_name_.end(), change.filename);
+        size_t index = it - frame_name_.begin();
+        bool   exists = (it != frame_name_.end() && *it == change.filename);
+
+        // A removed file takes its frame with it
+        if (change.deleted)
+        {
+            if (!exists) continue;
+            frame_data_.erase(frame_data_.begin() + index);
+            frame_name_.erase(frame_name_.begin() + index);
+            frame_crc_.erase(frame_crc_.begin() + index);
+            if (index < (size_t)current_frame_index_) --current_frame_index_;
+            continue;
+        }
+
+        // A modified file's frame is swapped for the new one
+        if (exists)
+        {
+            frame_data_[index].swap(change.data);
+            frame_crc_[index] = change.crc;
+            continue;
+        }
+
+        // A new file's frame is inserted in filename order
+        frame_data_.insert(frame_data_.begin() + index, std::move(change.data));
+        frame_name_.insert(frame_name_.begin() + index, change.filename);
+        frame_crc_.insert(frame_crc_.begin() + index, change.crc);
+        if (index < (size_t)current_frame_index_) ++current_frame_index_;
+    }
+
+    // Point the frames at the new frame-data
+    frame_.clear();
+    for (auto& v : frame_data_) frame_.push_back({v.data(), v.size()});
+    config.data_files = frame_name_;
+    forget_resident_frames();
+
+    if (config.verbose) printf("Watch: published %lu change(s), %lu frames\n", changes.size(), frame_.size());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// write_crc_manifest() - Writes a manifest containing the CRC of every frame
+//=================================================================================================
+void Feeder::write_crc_manifest(string filename)
+{
+    finish_loading();
+
+    FILE* ofile = fopen(filename.c_str(), "w");
+    if (ofile == nullptr) throwRuntime("Can't create %s", filename.c_str());
+
+    for (size_t index=0; index<frame_name_.size(); ++index)
+    {
+        string name = fs::path(frame_name_[index]).filename().string();
+        fprintf(ofile, "0x%08X %s\n", frame_crc_[index], name.c_str());
+    }
+
+    fclose(ofile);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stats() - Returns the running totals for the current (or most recent) job
+//=================================================================================================
+bce_stats_t Feeder::stats()
+{
+    lock_guard<mutex> lock(stats_mutex_);
+    return stats_;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// cadence_report() - Describes how closely the current (or most recent) job kept to its cadence
+//=================================================================================================
+bce_cadence_t Feeder::cadence_report()
+{
+    lock_guard<mutex> lock(stats_mutex_);
+    return cadence_.report();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// run() - Feeds bright-cycles until every frame has been sent.  The device must be open (or the
+//         registers attached) and the frames must be loaded
+//
+// Returns: false if the job was aborted
+//=================================================================================================
+bool Feeder::run()
+{
+    // Frames loaded in the background are packed as soon as the loader is done and no job is
+    // sending them: before this job if the loader has already finished, otherwise after it
+    if (frame_ready_ && frames_loaded_ == frame_.size()) finish_loading();
+    bool completed = run_abortable(&Feeder::feed_frames);
+    if (frame_ready_ && frames_loaded_ == frame_.size()) finish_loading();
+    return completed;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// calibrate() - Finds the fastest stable pacing for the open device and saves it as the
+//               device's pacing profile
+//
+// Returns: false if calibration was aborted
+//=================================================================================================
+bool Feeder::calibrate()
+{
+    finish_loading();
+    return run_abortable(&Feeder::calibrate_pacing);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// run_abortable() - Runs a job.  If an abort is requested, the device is brought to the same
+//                   state a normal stop leaves it in, and we record how long that took
+//
+// Returns: false if the job was aborted
+//=================================================================================================
+bool Feeder::run_abortable(void (Feeder::*job)())
+{
+    if (reg_base() == nullptr) throwRuntime("No device is open");
+    if (frame_.empty() && source_ == nullptr) throwRuntime("No frames to send");
+
+    // The abort register and control channel get polled right away
+    next_abort_poll_ = chrono::steady_clock::now();
+
+    try
+    {
+        (this->*job)();
+        show_register_counts();
+    }
+    catch(const job_aborted&)
+    {
+        // Bring the device to the same state a normal stop leaves it in
+        auto notice_time = chrono::steady_clock::now();
+        stop_job();
+        auto stop_time = chrono::steady_clock::now();
+
+        // Tell the bright-cycle count register how many bright-cycles were completed
+        reg_write(REG_BC_COUNT, bc_count_);
+
+        // Keep track of how long it took to honor the abort request
+        abort_noticed_us_ = chrono::duration_cast<chrono::microseconds>(notice_time - abort_request_time_).count();
+        abort_stopped_us_ = chrono::duration_cast<chrono::microseconds>(stop_time - abort_request_time_).count();
+        show_register_counts();
+        return false;
+    }
+
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// feed_frames() - Feeds bright-cycles until every frame has been sent.   Throws job_aborted if
+//                 an abort is requested
+//=================================================================================================
+void Feeder::feed_frames()
+{
+    auto start_time = chrono::steady_clock::now();
+
+    // Start at the first frame, with fresh statistics
+    current_frame_index_ = 0;
+    current_repeat_ = 0;
+    source_frames_ = 0;
+    bc_count_ = 0;
+    {
+        lock_guard<mutex> lock(stats_mutex_);
+        stats_ = {};
+        cadence_.start(config.cadence_hz);
+    }
+
+    // Streaming may have been turned on since the configuration was read
+    check_streaming(config);
+
+    // A bright-cycle that's longer than the cadence period can't keep to it
+    if (config.cadence_hz && config.bc_duration_us > 1e6 / config.cadence_hz)
+    {
+        fprintf(stderr, "Warning: bc_duration_us (%u) is longer than the %g Hz cadence allows\n",
+                config.bc_duration_us, config.cadence_hz);
+    }
+
+    // Reset the BC_EMU FIFOs, unless start_up() just did.  Either way, they hold nothing
+    if (!fifos_reset_) reset_fifos();
+    fifos_reset_ = false;
+    forget_resident_frames();
+
+    // Place BC_EMU into continuous mode, asking it to retain FIFO contents if it can
+    reg_write(REG_CONT_MODE, 1 | config.fifo_retain_mask);
+
+    // Sending bright-cycles to alternating FIFOs
+    uint32_t which_fifo = 0;
+    while (start_fifo(which_fifo))
+    {
+        // In verbose mode, show how long it took to get from loading the dataset to sending it
+        if (bc_count_ == 0 && config.verbose && source_ == nullptr && load_start_time_.time_since_epoch().count())
+        {
+            auto duration = chrono::steady_clock::now() - load_start_time_;
+            printf("First bright-cycle started %.3f ms after the dataset began loading (%lu of %lu frames loaded)\n",
+                   chrono::duration<double, milli>(duration).count(),
+                   frame_ready_ ? frames_loaded_.load() : frame_.size(), frame_.size());
+            load_start_time_ = {};
+        }
+
+        // The first bright-cycle is the end of startup
+        if (bc_count_ == 0 && config.verbose)
+        {
+            note_startup_phase("first bright-cycle", start_time);
+            show_startup_report();
+        }
+
+        reg_write(REG_BC_COUNT, bc_count_++);
+        which_fifo = 1 - which_fifo;
+    }
+
+    if (config.verbose && loader_waits_)
+    {
+        printf("The feeder caught up with the loader %u times\n", loader_waits_);
+    }
+
+    // Tell the bright-cycle count register how many bright-cycles
+    // were completed
+    reg_write(REG_BC_COUNT, bc_count_);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// reset_fifos() - Resets both BC_EMU FIFOs and waits for the reset to finish
+//=================================================================================================
+void Feeder::reset_fifos()
+{
+    forget_resident_frames();
+    reg_write(REG_FIFO_CTL, 3);
+    usleep(1000);
+    wait_for_register(REG_FIFO_CTL, 0, 1000, "FIFO reset");
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// Returns the index of the next frame to load into a fifo, or -1 if there are no more
+//=================================================================================================
+int Feeder::get_next_frame_index()
+{
+    // If this is the first time we've been called...
+    if (current_repeat_ == 0)
+    {
+        current_repeat_ = 1;
+        return current_frame_index_;
+    }
+
+    // We are either going to repeat this frame, or we
+    // need to increment to a new frame
+    if (current_repeat_ < config.max_repeats)
+        ++current_repeat_;
+    else
+    {
+        current_repeat_ = 1;
+        ++current_frame_index_;
+    }
+
+    if (current_frame_index_ < frame_.size())
+        return current_frame_index_;
+
+    // If we get here, there are no more frames of data
+    // available to send
+    return -1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// get_next_frame() - Fetches the next frame to load into a FIFO, either from the dataset or from
+//                    the live frame source.  When the source has no frame ready, the dry policy
+//                    decides whether we send the previous frame again, wait, or end the job.
+//                    Until the first frame arrives, we always wait
+//
+// On Exit: frame = The frame to send
+//          index = Its index in the dataset, or for a live source, the number of frames that
+//                  came before it
+//          crc   = Its CRC32C
+//
+// Returns: false if there are no more frames to send
+//=================================================================================================
+bool Feeder::get_next_frame(bce_frame_t& frame, int& index, uint32_t& crc)
+{
+    // Without a live source, frames come from the dataset
+    if (source_ == nullptr)
+    {
+        // In watch mode, this is where changed files take effect.  The dataset is sent over and
+        // over, and if every file has been removed, we wait for one to appear
+        if (config.watch)
+        {
+            apply_dataset_changes();
+            while (frame_.empty())
+            {
+                check_abort();
+                usleep(max(config.abort_latency_us / 2, 1u));
+                apply_dataset_changes();
+            }
+            if (current_frame_index_ >= (int)frame_.size()) current_frame_index_ = current_repeat_ = 0;
+        }
+
+        index = get_next_frame_index();
+        if (index < 0 && config.watch)
+        {
+            current_frame_index_ = index = 0;
+            current_repeat_ = 1;
+        }
+        if (index < 0) return false;
+
+        // With progressive loading, the frame might not be ready yet
+        wait_for_frame(index);
+        frame = frame_[index];
+        crc   = frame_crc_[index];
+
+        // The first time a frame from a pack is sent, start reading it and the frame after it
+        // from disk
+        if (frame_pack_.is_open() && current_repeat_ == 1)
+        {
+            frame_pack_.prefetch(index);
+            frame_pack_.prefetch(index + 1);
+        }
+        return true;
+    }
+
+    uint32_t wait_us = 0;
+    while (true)
+    {
+        auto status = source_->next_frame(frame, wait_us);
+        if (status == FRAME_READY) break;
+        if (status == FRAME_END)   return false;
+
+        // The source has run dry.  Count it once per hand-off
+        if (wait_us == 0 && source_frames_)
+        {
+            span_trace_.instant("source dry", "control", "frames", source_frames_);
+            lock_guard<mutex> lock(stats_mutex_);
+            ++stats_.source_dry;
+        }
+
+        // Once the job has started, the dry policy might not want to wait
+        if (source_frames_ && config.dry_policy == DRY_STOP) return false;
+        if (source_frames_ && config.dry_policy == DRY_REPEAT)
+        {
+            frame = last_frame_;
+            index = source_frames_ - 1;
+            crc   = last_crc_;
+            return true;
+        }
+
+        // Wait for the source, honoring abort requests as we do
+        check_abort();
+        wait_us = max(config.abort_latency_us / 2, 1u);
+    }
+
+    // Remember this frame in case we have to send it again
+    last_frame_ = frame;
+    last_crc_   = crc = crc32c(frame.data, frame.size * sizeof(uint32_t));
+    index       = source_frames_++;
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// load_words() - Writes a block of frame-data words into a FIFO register.  If "patch" isn't
+//                null, any of those words that has a patch is replaced by the patch's value
+//=================================================================================================
+void Feeder::load_words(reg_id_t fifo, const uint32_t* data, size_t count, patch_cursor_t* patch)
+{
+    // Between delays (or every so often, if there are no delays) we check for an abort
+    const size_t chunk = config.word_delay_us ? config.burst_size : min(config.burst_size, 256u);
+
+    with_registers([&](auto& regs)
+    {
+        while (count)
+        {
+            check_abort();
+
+            // Write a burst of words back-to-back
+            size_t burst = min(count, chunk);
+            if (patch == nullptr) regs.write_block(fifo, data, burst);
+
+            // Write the run of words up to each patch, then the patch's value in place of the
+            // word it replaces
+            else
+            {
+                const uint32_t* p = data;
+                size_t          n = burst;
+                while (patch->next != patch->end && patch->next->index < patch->index + n)
+                {
+                    size_t run = patch->next->index - patch->index;
+                    regs.write_block(fifo, p, run);
+                    regs.write(fifo, patch->next->value);
+                    p            += run + 1;
+                    n            -= run + 1;
+                    patch->index += run + 1;
+                    ++patch->next;
+                }
+                regs.write_block(fifo, p, n);
+                patch->index += n;
+            }
+
+            data  += burst;
+            count -= burst;
+
+            // After each burst of words, give the RTL time to catch up
+            if (config.word_delay_us) usleep(config.word_delay_us);
+        }
+    });
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stream_words() - Writes frame-data words into a FIFO that the RTL may already be draining,
+//                  never writing more words than the FIFO has room for.
+//
+// Returns: The number of times we found the FIFO empty (i.e., the number of times the RTL got
+//          ahead of us)
+//=================================================================================================
+int Feeder::stream_words
+(
+    reg_id_t           fifo,
+    reg_id_t           level,
+    const uint32_t*    data,
+    size_t             count,
+    patch_cursor_t*    patch
+)
+{
+    int underruns = 0;
+
+    while (count)
+    {
+        // Find out how many entries are currently in the FIFO
+        uint32_t fill_level = reg_read(level);
+
+        // If the FIFO is empty, the RTL has caught up with us
+        if (fill_level == 0) ++underruns;
+
+        // How many words can we write without overflowing the FIFO?
+        size_t room = (fill_level < config.fifo_depth) ? config.fifo_depth - fill_level : 0;
+
+        // If the FIFO is full, give the RTL a chance to drain it
+        if (room == 0)
+        {
+            check_abort();
+            usleep(config.word_delay_us ? config.word_delay_us : 1);
+            continue;
+        }
+
+        // Write as many words as there is room for
+        if (room > count) room = count;
+        load_words(fifo, data, room, patch);
+        data  += room;
+        count -= room;
+    }
+
+    // Tell the caller how many times the FIFO ran dry
+    return underruns;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// This loads a FIFO, tells the RTL to start sending frames using the data from that FIFO, and
+// waits for the RTL to report that it has begun doing so
+//=================================================================================================
+bool Feeder::start_fifo(uint32_t which)
+{
+    // The FIFO register
+    reg_id_t           fifo;
+
+    // The FIFO's fill-level register
+    reg_id_t           level;
+
+    // This will have a 1 in bit 0 or in bit 1
+    uint32_t           fifo_bit;
+
+    // Keep track of when this process starts
+    auto start_time = chrono::steady_clock::now();
+
+    // Determine the runtime parameters for this particular FIFO
+    if (which == 0)
+    {
+        fifo = REG_FIFO0;
+        level = REG_FIFO0_LEVEL;
+        fifo_bit = 1 << 0;
+    }
+    else
+    {
+        fifo = REG_FIFO1;
+        level = REG_FIFO1_LEVEL;
+        fifo_bit = 1 << 1;
+    }
+
+    // Find the frame data we should load into the FIFO
+    bce_frame_t frame;
+    int         index;
+    uint32_t    crc;
+    bool        have_frame;
+    {
+        TraceScope span(span_trace_, "get frame", "fifo");
+        have_frame = get_next_frame(frame, index, crc);
+    }
+
+    // If the RTL retains FIFO contents and this FIFO still holds this very frame, it only
+    // needs to be re-armed
+    auto& resident = resident_[which];
+    bool rearm = have_frame && resident.words && resident.words == frame.size
+              && resident.data == frame.data && resident.crc == crc;
+
+    // Otherwise, reset the FIFO (i.e., remove any existing entries)
+    if (!rearm)
+    {
+        TraceScope span(span_trace_, "FIFO reset", "fifo", "fifo", which);
+        resident = {};
+        reg_write(REG_FIFO_CTL, fifo_bit);
+        wait_for_register(REG_FIFO_CTL, 0, 100, "FIFO reset");
+    }
+
+    // Before starting a new bright-cycle, always check for an abort request
+    check_abort(true);
+
+    // If we have frame-data to load into the FIFO...
+    if (have_frame)
+    {
+        // A frame from a patch file is its base frame, patched as it's written
+        patch_cursor_t  cursor, *patch = nullptr;
+        if (source_ == nullptr && !patch_data_.frame.empty())
+        {
+            auto& entry = patch_data_.frame[index];
+            cursor.next  = patch_data_.patch.data() + entry.first_patch;
+            cursor.end   = cursor.next + entry.patch_count;
+            cursor.index = 0;
+            patch = &cursor;
+        }
+
+        // In normal mode, the entire frame is loaded before the FIFO goes on
+        // deck.  In streaming mode, only the first "stream_prefix" words are
+        size_t prefix = frame.size;
+        if (config.stream_prefix && prefix > config.stream_prefix) prefix = config.stream_prefix;
+        if (config.stream_prefix && prefix > config.fifo_depth)    prefix = config.fifo_depth;
+
+        // Load the frame data into the FIFO, unless it's already there
+        int64_t load_ns = span_trace_.enabled() ? SpanTrace::now_ns() : 0;
+        if (rearm)
+            prefix = frame.size;
+        else
+            load_words(fifo, frame.data, prefix, patch);
+
+        // With a cadence, the loaded FIFO is held until its slot
+        if (cadence_.enabled()) wait_for_slot();
+
+        // Tell the RTL to put this FIFO "on deck"
+        reg_write(REG_FIFO_SELECT, fifo_bit);
+        if (cadence_.enabled())
+        {
+            lock_guard<mutex> lock(stats_mutex_);
+            cadence_.handed_off(SpanTrace::now_ns());
+        }
+
+        // Keep track of when the FIFO went on deck
+        auto deck_time = chrono::steady_clock::now();
+
+        // Top up the FIFO with the rest of the frame while the RTL drains it
+        int underruns = stream_words(fifo, level, frame.data + prefix, frame.size - prefix, patch);
+
+        // A FIFO the RTL retains still holds the frame after sending it, as long as the whole
+        // frame was in the FIFO at once
+        if (config.fifo_retain_mask && !rearm && prefix == frame.size
+        &&  (config.fifo_depth == 0 || frame.size <= config.fifo_depth))
+        {
+            resident = {frame.data, frame.size, crc};
+        }
+
+        // Keep track of when the "load FIFO" process completes
+        auto end_time = chrono::steady_clock::now();
+
+        // Compute the durations in milliseconds
+        auto duration = chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+        auto deck_duration = chrono::duration_cast<std::chrono::milliseconds>(deck_time - start_time);
+
+        // In verbose mode, show the load time
+        if (config.verbose)
+        {
+            if (rearm)
+                printf
+                (
+                    "Re-armed bright-cycle %i in FIFO %i (CRC 0x%08X)... ",
+                    index, which, crc
+                );
+            else if (config.stream_prefix)
+                printf
+                (
+                    "Streamed bright-cycle %i into FIFO %i (CRC 0x%08X, on deck %lu ms, loaded %lu ms, %i underruns)... ",
+                    index, which, crc, deck_duration.count(), duration.count(), underruns
+                );
+            else
+                printf
+                (
+                    "Loaded bright-cycle %i into FIFO %i (CRC 0x%08X, %lu ms)... ",
+                    index, which, crc, duration.count()
+                );
+            fflush(stdout);
+        }
+
+        // Wait for the RTL to make this FIFO active
+        int64_t wait_ns = span_trace_.enabled() ? SpanTrace::now_ns() : 0;
+        wait_for_register(REG_FIFO_SELECT, fifo_bit, 1000, "FIFO to become active", true, true);
+
+        // Put the load and the wait into the timeline
+        if (load_ns)
+        {
+            span_trace_.span(rearm ? "re-arm" : "load", "fifo", load_ns, wait_ns, "frame", index);
+            span_trace_.span("wait for active", "fifo", wait_ns, SpanTrace::now_ns(), "fifo", which);
+        }
+
+        // In verbose mode, show when the FIFO is in use
+        if (config.verbose) printf("started\n");
+
+        // Describe the bright-cycle that just started
+        bce_bc_info_t info;
+        info.bc_count    = bc_count_;
+        info.frame_index = index;
+        info.fifo        = which;
+        info.crc         = crc;
+        info.words       = frame.size;
+        info.underruns   = underruns;
+        info.on_deck_ms  = chrono::duration<double, milli>(deck_time - start_time).count();
+        info.load_ms     = chrono::duration<double, milli>(end_time  - start_time).count();
+
+        // Keep the running totals up to date
+        {
+            lock_guard<mutex> lock(stats_mutex_);
+            stats_.bright_cycles    += 1;
+            stats_.words_written    += rearm ? 0 : frame.size;
+            stats_.stream_underruns += underruns;
+            stats_.fifo_rearms      += rearm;
+            stats_.last_load_ms      = info.load_ms;
+            stats_.max_load_ms       = max(stats_.max_load_ms, info.load_ms);
+            stats_.total_load_ms    += info.load_ms;
+        }
+
+        // Tell the caller that a new bright-cycle has started
+        if (callback_) callback_(info);
+
+        // And tell the caller that his FIFO is loaded and active
+        return true;
+    }
+
+    // If we get here, we have no more frame-data to send
+    stop_job();
+
+    // Tell the caller that the job is complete
+    return false;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop_job() - Tells the RTL to stop sending bright-cycles and waits for it to do so
+//=================================================================================================
+void Feeder::stop_job()
+{
+    TraceScope span(span_trace_, "stop job", "control");
+
+    // In verbose mode, tell the user we're stopping the job
+    if (config.verbose)
+    {
+        printf("Stopping job... "); fflush(stdout);
+    }
+
+    // Tell the RTL to stop, and wait for it to acknowledge
+    reg_write(REG_FIFO_SELECT, 0);
+    wait_for_register(REG_FIFO_SELECT, 0, 1000, "the RTL to stop", false);
+
+    // In verbose mode, tell the user we're done
+    if (config.verbose) printf("final frame sent, job complete\n");
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// register_name() - Returns the configured name of the register at the specified offset, or the
+//                   offset in hex if it's unknown
+//=================================================================================================
+string Feeder::register_name(uint32_t offset) const
+{
+    for (int id = 0; id < REG_COUNT; ++id)
+    {
+        if (config.registers.offset[id] == offset) return register_map_t::name((reg_id_t)id);
+    }
+
+    char buffer[20];
+    sprintf(buffer, "0x%04X", offset);
+    return buffer;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// show_register_counts() - When register accesses are being counted, shows (in verbose mode) how
+//                          many times each register was read and written
+//=================================================================================================
+void Feeder::show_register_counts()
+{
+    if (reg_access_ != ACCESS_COUNTING || !config.verbose) return;
+
+    auto& reads  = counting_regs_.reads;
+    auto& writes = counting_regs_.writes;
+
+    printf("Register accesses:\n");
+    for (size_t index = 0; index < reads.size(); ++index)
+    {
+        if (reads[index] == 0 && writes[index] == 0) continue;
+        printf
+        (
+            "  %-12s %10lu reads %10lu writes\n",
+            register_name(index * 4).c_str(), reads[index], writes[index]
+        );
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// replay() - Re-drives recorded register accesses against a memory-backed stand-in for the
+//            register space.  Reads are primed with the value the device returned
+//
+// Returns: The time it took, in nanoseconds
+//=================================================================================================
+double Feeder::replay(const vector<reg_trace_rec_t>& records)
+{
+    // Find out how big the register space needs to be
+    uint32_t max_offset = 0;
+    for (auto& rec : records) max_offset = max(max_offset, rec.offset & ~REG_TRACE_WRITE);
+
+    // Create the memory-backed stand-in for the register space
+    attach_memory_registers(max_offset + 4);
+
+    // Re-drive every access
+    auto start_time = chrono::steady_clock::now();
+    with_registers([&](auto& regs)
+    {
+        for (auto& rec : records)
+        {
+            uint32_t offset = rec.offset & ~REG_TRACE_WRITE;
+            if (rec.offset & REG_TRACE_WRITE)
+                regs.write_offset(offset, rec.value);
+            else
+            {
+                *(volatile uint32_t*)(regs.base() + offset) = rec.value;
+                regs.read_offset(offset);
+            }
+        }
+    });
+    auto end_time = chrono::steady_clock::now();
+
+    return chrono::duration_cast<chrono::nanoseconds>(end_time - start_time).count();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// measure_usleep() - Returns the average number of microseconds that a call to usleep()
+//                    actually takes for the requested delay
+//=================================================================================================
+static double measure_usleep(uint32_t delay_us, int samples)
+{
+    if (delay_us == 0) return 0;
+
+    auto start_time = chrono::steady_clock::now();
+    for (int i=0; i<samples; ++i) usleep(delay_us);
+    auto end_time = chrono::steady_clock::now();
+
+    return chrono::duration<double, micro>(end_time - start_time).count() / samples;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// measure_word_write() - Returns the average number of nanoseconds it takes to write one
+//                        frame-data word into a FIFO register, measured against the
+//                        memory-backed register space
+//=================================================================================================
+double Feeder::measure_word_write()
+{
+    uint64_t words = 0;
+    auto     start_time = chrono::steady_clock::now();
+    double   elapsed_ns = 0;
+
+    // Write the entire dataset as many times as it takes to get a decent sample
+    while (elapsed_ns < 50e6)
+    {
+        for (auto& frame : frame_)
+        {
+            with_registers([&](auto& regs) {regs.write_block(REG_FIFO0, frame.data, frame.size);});
+            words += frame.size;
+        }
+        auto now = chrono::steady_clock::now();
+        elapsed_ns = chrono::duration<double, nano>(now - start_time).count();
+        if (words == 0) break;
+    }
+
+    return words ? elapsed_ns / words : 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// predict() - Measures how quickly this host can feed words into a FIFO, and predicts the load
+//             time and slack of every bright-cycle.  The frames must already be loaded.  This
+//             never touches the card
+//=================================================================================================
+void Feeder::predict()
+{
+    const feeder_config_t& c = config;
+
+    // We can't predict slack without knowing how long a bright-cycle lasts
+    if (c.bc_duration_us == 0) throwRuntime("bc_duration_us must be configured for -predict");
+
+    // Every frame has to be in memory
+    finish_loading();
+
+    // Point the registers at a memory-backed stand-in for the device
+    attach_memory_registers(0);
+
+    // Measure the per-word cost of loading a FIFO on this host
+    double write_us = measure_word_write() / 1000;
+    double delay_us = measure_usleep(c.word_delay_us, 200) / c.burst_size;
+    double reset_us = measure_usleep(100, 50);
+    double word_us  = write_us + delay_us;
+
+    printf("Per-word cost: %.3f us write + %.1f us pacing (word_delay_us = %u, burst_size = %u)\n",
+           write_us, delay_us, c.word_delay_us, c.burst_size);
+    printf("FIFO reset: %.1f us, bright-cycle: %u us\n", reset_us, c.bc_duration_us);
+
+    int    late_handoffs = 0, total_handoffs = 0;
+    double min_slack_us = 1e30;
+
+    for (size_t index=0; index<frame_.size(); ++index)
+    {
+        double words = frame_[index].size;
+        string note;
+
+        // Determine how many words are loaded before the FIFO goes on deck
+        double prefix = words;
+        if (c.stream_prefix && prefix > c.stream_prefix) prefix = c.stream_prefix;
+        if (c.stream_prefix && prefix > c.fifo_depth)    prefix = c.fifo_depth;
+
+        // How long until the FIFO is on deck, and until it's fully loaded?
+        double deck_us = reset_us + prefix * word_us;
+        double load_us = reset_us + words  * word_us;
+
+        // The FIFO must be on deck before the previous bright-cycle ends
+        double slack_us = c.bc_duration_us - deck_us;
+        bool   late = slack_us < 0;
+
+        // Without streaming, the whole frame must fit in the FIFO
+        if (!c.stream_prefix && c.fifo_depth && words > c.fifo_depth)
+        {
+            late = true;
+            note = " (exceeds fifo_depth)";
+        }
+
+        // In streaming mode, we have to write each word before the RTL needs it
+        if (c.stream_prefix && words > prefix)
+        {
+            double active_us = max(deck_us, (double)c.bc_duration_us);
+            double us_per_word_sent = c.bc_duration_us / words;
+            double first_needed = active_us + prefix * us_per_word_sent;
+            double last_needed  = active_us + (words - 1) * us_per_word_sent;
+            double first_written = reset_us + (prefix + 1) * word_us;
+            if (first_written > first_needed || load_us > last_needed)
+            {
+                late = true;
+                note = " (stream underrun)";
+            }
+        }
+
+        printf
+        (
+            "Frame %5lu: %6.0f words, on deck %10.1f us, loaded %10.1f us, slack %10.1f us%s%s\n",
+            index, words, deck_us, load_us, slack_us, late ? " LATE" : "", note.c_str()
+        );
+
+        // This frame is sent max_repeats times.  The very first hand-off of
+        // the job has no previous bright-cycle to race against
+        int handoffs = (index == 0) ? c.max_repeats - 1 : c.max_repeats;
+        total_handoffs += handoffs;
+        if (late) late_handoffs += handoffs;
+        if (handoffs) min_slack_us = min(min_slack_us, slack_us);
+    }
+
+    // Show the summary
+    if (total_handoffs == 0)
+        printf("Only one bright-cycle will be sent, so there is nothing to keep up with\n");
+    else
+        printf
+        (
+            "Predicted underruns: %i of %i hand-offs (%.1f%%), minimum slack %.1f us\n",
+            late_handoffs, total_handoffs, late_handoffs * 100.0 / total_handoffs, min_slack_us
+        );
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// calibration_trial() - Sends a pair of bright-cycles using the current pacing settings and
+//                       reports whether either FIFO overflowed or underran
+//
+// Returns: true if the pacing settings are stable
+//=================================================================================================
+bool Feeder::calibration_trial(const bce_frame_t& frame)
+{
+    const uint32_t error_mask = config.fifo_overflow_mask | config.fifo_underrun_mask;
+
+    // Clear any sticky error bits
+    reg_write(REG_FIFO_STATUS, reg_read(REG_FIFO_STATUS) & error_mask);
+
+    // Load each FIFO and wait for the RTL to start sending it
+    for (uint32_t which = 0; which < 2; ++which)
+    {
+        uint32_t fifo_bit = 1 << which;
+        reg_write(REG_FIFO_CTL, fifo_bit);
+        wait_for_register(REG_FIFO_CTL, 0, 100, "FIFO reset");
+        load_words(which ? REG_FIFO1 : REG_FIFO0, frame.data, frame.size);
+        reg_write(REG_FIFO_SELECT, fifo_bit);
+        wait_for_register(REG_FIFO_SELECT, fifo_bit, 1000, "FIFO to become active", true, true);
+    }
+
+    // Let the second bright-cycle finish
+    reg_write(REG_FIFO_SELECT, 0);
+    wait_for_register(REG_FIFO_SELECT, 0, 1000, "the RTL to stop");
+
+    // Did either FIFO report an error?
+    return (reg_read(REG_FIFO_STATUS) & error_mask) == 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// pacing_is_stable() - Returns true if the specified pacing survives every calibration trial
+//=================================================================================================
+bool Feeder::pacing_is_stable(const bce_frame_t& frame, uint32_t delay_us, uint32_t burst_size)
+{
+    config.word_delay_us = delay_us;
+    config.burst_size    = burst_size;
+
+    bool stable = true;
+    for (uint32_t trial = 0; stable && trial < config.calibrate_trials; ++trial)
+    {
+        stable = calibration_trial(frame);
+    }
+
+    if (config.verbose)
+    {
+        printf("  word_delay_us = %3u, burst_size = %5u: %s\n",
+               delay_us, burst_size, stable ? "stable" : "errors");
+    }
+
+    return stable;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// calibrate_pacing() - Binary-searches for the smallest stable delay between words, then for the
+//                      largest stable burst size at that delay, and saves the result as this
+//                      device's profile
+//=================================================================================================
+void Feeder::calibrate_pacing()
+{
+    // We can't tell whether pacing is stable without the FIFO error bits
+    if (config.registers[REG_FIFO_STATUS] == 0 || (config.fifo_overflow_mask | config.fifo_underrun_mask) == 0)
+    {
+        throwRuntime("reg_fifo_status, fifo_overflow_mask and fifo_underrun_mask must be configured to calibrate");
+    }
+
+    // We calibrate using the largest frame in the dataset
+    if (frame_.empty()) throwRuntime("Calibration needs a dataset");
+    auto& frame = *max_element
+    (
+        frame_.begin(), frame_.end(),
+        [](const bce_frame_t& a, const bce_frame_t& b) {return a.size < b.size;}
+    );
+
+    // The trials change the pacing in the configuration, don't ask the RTL to retain what's in
+    // a FIFO, and leave frame-data in both FIFOs.  Whatever happens, put all of that back the
+    // way the job expects it
+    const uint32_t saved_delay = config.word_delay_us, saved_burst = config.burst_size;
+    auto restore = [&](uint32_t delay_us, uint32_t burst_size)
+    {
+        config.word_delay_us = delay_us;
+        config.burst_size    = burst_size;
+        reg_write(REG_CONT_MODE, 1 | config.fifo_retain_mask);
+        fifos_reset_ = false;
+    };
+
+    uint32_t best_delay, best_burst;
+    try
+    {
+        // Get the RTL ready to send bright-cycles
+        reset_fifos();
+        reg_write(REG_CONT_MODE, 1);
+
+        printf("Calibrating %s with a %lu-word frame\n", device_.bdf().c_str(), frame.size);
+
+        // The configured pacing is our known-good starting point
+        uint32_t max_delay = config.word_delay_us;
+        if (!pacing_is_stable(frame, max_delay, 1))
+        {
+            throwRuntime("Configured pacing (word_delay_us = %u) isn't stable", max_delay);
+        }
+
+        // Find the smallest stable delay between words
+        uint32_t lo = 0, hi = max_delay;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi) / 2;
+            if (pacing_is_stable(frame, mid, 1)) hi = mid; else lo = mid + 1;
+        }
+        best_delay = hi;
+
+        // Now find the largest stable burst size at that delay
+        uint32_t max_burst = config.fifo_depth ? config.fifo_depth : frame.size;
+        best_burst = 1;
+        lo = 1; hi = max(max_burst, 1u);
+        while (best_delay && lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            if (pacing_is_stable(frame, best_delay, mid)) lo = mid; else hi = mid - 1;
+        }
+        if (best_delay) best_burst = lo;
+    }
+    catch(...)
+    {
+        restore(saved_delay, saved_burst);
+        throw;
+    }
+
+    // The job goes on with the pacing we found
+    restore(best_delay, best_burst);
+
+    // Save the result as the profile for this device and RTL version
+    string filename = profile_filename();
+    fs::create_directories(config.profile_dir);
+    FILE* ofile = fopen(filename.c_str(), "w");
+    if (ofile == nullptr) throwRuntime("Can't create %s", filename.c_str());
+    fprintf(ofile, "# Pacing profile for %s, created by bce_feeder -calibrate\n", device_.bdf().c_str());
+    fprintf(ofile, "word_delay_us = %u\n", best_delay);
+    fprintf(ofile, "burst_size = %u\n", best_burst);
+    fclose(ofile);
+
+    printf("Saved %s: word_delay_us = %u, burst_size = %u\n",
+           filename.c_str(), best_delay, best_burst);
+}
+//=================================================================================================
@@ -0,0 +1,588 @@
+//=================================================================================================
+// feeder.h - Defines the engine that feeds frame-data to BC_EMU, one bright-cycle at a time
+//
+// This is the C++ interface of libbcefeeder.  The C interface is in bcefeeder.h
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include "bcefeeder.h"
+#include "PciDevice.h"
+#include "frame_reader.h"
+#include "frame_transform.h"
+#include "column_layout.h"
+#include "reg_trace.h"
+#include "span_trace.h"
+#include "register_block.h"
+#include "frame_source.h"
+#include "socket_source.h"
+#include "shm_source.h"
+#include "dir_watch.h"
+#include "numa_placement.h"
+#include "frame_patch.h"
+#include "frame_pack.h"
+#include "cadence.h"
+
+// This is the value of the RTL ID register when BC_EMU is loaded
+const uint32_t BC_EMU_RTL_ID = 912018;
+
+// This is thrown when a Feeder notices a request to abort the job
+class job_aborted : public std::runtime_error
+{
+public:
+    job_aborted() : runtime_error("job aborted") {}
+};
+
+
+//=================================================================================================
+// feeder_config_t - The settings that govern a job.  Every one of these can be set from the
+//                   configuration file
+//=================================================================================================
+struct feeder_config_t
+{
+    std::string pci_device;
+    std::string dir;
+
+    // How the device is mapped (see PciDevice.h)
+    PciDevice::access_t device_access = PciDevice::ACCESS_AUTO;
+
+    // The directory that PCI devices are looked for in.  Empty = /sys/bus/pci/devices
+    std::string device_dir;
+
+    // If true, and the device's interrupts are available to us, we sleep until the RTL
+    // interrupts us rather than polling for a FIFO switch
+    bool        interrupts = true;
+    int         max_repeats = 1;
+    bool        verbose = false;
+
+    // If true, the dataset directory is watched, and files that change are re-read in the
+    // background.  The job then sends the dataset over and over until it's aborted
+    bool        watch = false;
+
+    // If true, the feeder thread and its memory are kept on the card's NUMA node
+    bool        numa = true;
+
+    // If true, frame-data is kept in huge pages when the system has any
+    bool        huge_pages = true;
+
+    // If not empty, every register access is recorded into this file
+    std::string reg_trace_file;
+
+    // If not empty, a timeline of the run is written to this file (as Chrome trace-event JSON)
+    // when the device is closed, with room for "trace_capacity" spans
+    std::string trace_file;
+    uint32_t    trace_capacity = 262144;
+
+    // How frame-data files are read from disk
+    read_method_t read_method = READ_MMAP;
+
+    // If true, frame-data files are parsed on background threads, and the job starts as soon
+    // as the first frame is ready.  The feeder only waits if it catches up with the loader
+    bool        progressive_load = true;
+
+    // The number of datasets kept in memory, so that a dataset can be loaded again without
+    // re-reading its files.  0 = Every load reads from disk
+    uint32_t dataset_cache = 4;
+
+    // The number of 32-bit entries each FIFO can hold
+    uint32_t fifo_depth = 0;
+
+    // The delay (in microseconds) after writing each burst of words to a FIFO
+    uint32_t word_delay_us = 25;
+
+    // The number of words written back-to-back between delays
+    uint32_t burst_size = 1;
+
+    // The directory where per-device pacing profiles are kept
+    std::string profile_dir = "profiles";
+
+    // The number of bright-cycle pairs each calibration setting must survive
+    uint32_t calibrate_trials = 3;
+
+    // Bits in reg_fifo_status that report FIFO overflow and underrun
+    uint32_t fifo_overflow_mask = 0;
+    uint32_t fifo_underrun_mask = 0;
+
+    // Bits in reg_cont_mode that make the RTL retain a FIFO's contents after sending them, so
+    // that the FIFO can be re-armed without being reloaded.  0 = The RTL drains its FIFOs
+    uint32_t fifo_retain_mask = 0;
+
+    // How long (in microseconds) the RTL takes to send one bright-cycle
+    uint32_t bc_duration_us = 0;
+
+    // An abort request must be noticed within this many microseconds
+    uint32_t abort_latency_us = 10000;
+
+    // If non-zero, waiting on the RTL for longer than this is an error
+    uint32_t wait_timeout_ms = 0;
+
+    // In streaming mode, this many words are loaded before the FIFO is
+    // placed "on deck".  0 = Streaming mode disabled
+    uint32_t stream_prefix = 0;
+
+    // If non-zero, each loaded FIFO is held until its slot on a timeline of this many
+    // bright-cycles per second before it's placed on deck.  0 = As fast as the FIFOs load
+    double   cadence_hz = 0;
+
+    // The offset of every BC_EMU register
+    register_map_t registers = BC_EMU_REGISTERS;
+
+    // If true, every register read and write is counted, and the counts are shown in verbose
+    // mode after each job
+    bool        count_registers = false;
+
+    // This is a list of data-files to use for frame-data
+    std::vector<std::string> data_files;
+
+    // If not empty, this turns the columns of each row of a CSV file into frame-data words.
+    // It's applied as the file is read, before the transforms
+    ColumnLayout columns;
+
+    // These transforms are applied to every frame as it's read from disk
+    FrameTransform transform;
+
+    // If not empty, this file lists the expected CRC32C of each data-file
+    std::string crc_manifest;
+
+    // If not empty, the dataset is read from this patch file (see frame_patch.h) rather than
+    // from data-files.  Only the base frames are kept whole; every other word is written into
+    // the FIFO straight from the frame's patch list
+    std::string patch_file;
+
+    // If not empty, the dataset is the frames in this frame pack (see frame_pack.h).  They're
+    // sent from where they lie in the mapped file, and read from disk as they're needed
+    std::string frame_pack;
+
+    // If not empty, frames are received from producers on this unix-domain socket
+    std::string frame_socket;
+
+    // The number of received frames that may wait to be sent
+    uint32_t queue_depth = 8;
+
+    // What to do when a live frame source has no frame ready
+    dry_policy_t dry_policy = DRY_REPEAT;
+
+    // If not empty, frames are taken from a shared-memory ring of this name
+    std::string shm_ring;
+
+    // The number of slots in the ring, and the capacity of each slot in 32-bit words
+    uint32_t shm_slots = 8;
+    uint32_t shm_slot_words = 65536;
+};
+//=================================================================================================
+
+
+//=================================================================================================
+// Feeder - Feeds frames to a BC_EMU device through its pair of FIFOs
+//=================================================================================================
+class Feeder
+{
+public:
+
+    // Constructor and destructor
+    Feeder() {traced_regs_.trace = &reg_trace_;}
+    ~Feeder() {finish_loading(true);}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    Feeder(const Feeder&) = delete;
+    Feeder& operator= (const Feeder&) = delete;
+
+    // The settings for the job.  Change these before opening the device
+    feeder_config_t config;
+
+    // Reads settings from a configuration file.  Throws runtime_error on failure
+    void    read_config(std::string filename);
+
+    // Changes a single numeric setting, named as it is in the configuration file
+    void    set_option(std::string name, uint32_t value);
+
+    // Maps the PCI device, makes sure BC_EMU is idle, and (optionally) loads the pacing
+    // profile for this device
+    void    open_device(bool use_profile = true);
+
+    // Does the work of open_device() while "prepare_frames" (e.g., a call to load_dataset())
+    // runs on a thread of its own, and resets the FIFOs ready for the first bright-cycle.  If
+    // either side throws, the exception is re-thrown once both are finished
+    void    start_up(std::function<void()> prepare_frames, bool use_profile = true);
+
+    // Records a startup phase that ran from "start" to "end".  In verbose mode, the startup
+    // phases are shown when the first bright-cycle starts
+    void    note_startup_phase(const char* name, std::chrono::steady_clock::time_point start,
+                               std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now(),
+                               bool background = false);
+
+    // Stops any register trace and unmaps the device
+    void    close();
+
+    // Points the registers at an already-mapped register space
+    void    attach_registers(uint8_t* base);
+
+    // Points the registers at a memory-backed stand-in for the register space
+    void    attach_memory_registers(uint32_t size = 0);
+
+    // Reads the frame-data files named by config.patch_file, config.frame_pack, config.dir or
+    // config.data_files.  With progressive loading, this returns as soon as the files are being
+    // read in the background.  Any live source is stopped
+    void    load_dataset();
+
+    // Waits for a dataset being loaded in the background to finish.  Throws the first error
+    // the loader ran into.  If "cancel" is true, the loader is stopped instead, and any error
+    // is ignored
+    void    finish_loading(bool cancel = false);
+
+    // Returns true if the last load_dataset() found the dataset already in memory
+    bool    dataset_cached() const {return dataset_cached_;}
+
+    // Sends frames straight from caller memory.  The frames aren't copied, and must remain
+    // valid until run() returns.  Transforms aren't applied to them.  Any live source is stopped
+    void    set_frames(const bce_frame_t* frames, size_t count);
+
+    // Takes frames from a live source instead of from the dataset.  The source must remain
+    // valid until run() returns.  nullptr goes back to using the dataset
+    void    set_source(FrameSource* source) {source_ = source;}
+
+    // Takes frames from producers that connect to a unix-domain socket at "path"
+    void    listen(std::string path);
+
+    // Takes frames from a producer that writes them into a shared-memory ring called "name"
+    void    create_ring(std::string name);
+
+    // Stops the socket or shared-memory source (if there is one), and goes back to using the
+    // dataset
+    void    stop_source();
+
+    // Arranges for "callback" to be called at the start of every bright-cycle
+    void    on_bright_cycle(std::function<void(const bce_bc_info_t&)> callback)
+            {callback_ = callback;}
+
+    // Sends every frame.  Returns false if the job was aborted
+    bool    run();
+
+    // Finds the fastest stable pacing for this device and saves it as the device's profile.
+    // Returns false if calibration was aborted
+    bool    calibrate();
+
+    // Predicts the load time and slack of every frame without touching the device
+    void    predict();
+
+    // Writes the CRC32C of every frame into a manifest file
+    void    write_crc_manifest(std::string filename);
+
+    // Builds a frame pack from the files named by config.dir or config.data_files, with the
+    // column layout and transforms applied.  Returns the number of frames in it
+    size_t  write_frame_pack(std::string filename);
+
+    // Asks a running job to stop.  Safe to call from any thread or from a signal handler
+    void    request_abort(const char* source);
+
+    // Forgets an abort request that no job has noticed, so that it can't stop the next job
+    void    clear_abort_request() {abort_request_.store(nullptr, std::memory_order_release);}
+
+    // Abort requests are also accepted as "abort" datagrams on this socket
+    void    set_control_socket(int sd) {control_socket_ = sd;}
+
+    // After an aborted job, these describe where the request came from, and how many
+    // microseconds it took to notice it and to stop the device
+    const char* abort_source() const {return abort_source_;}
+    int64_t abort_noticed_us() const {return abort_noticed_us_;}
+    int64_t abort_stopped_us() const {return abort_stopped_us_;}
+
+    // Fetches the running totals for the current (or most recent) job
+    bce_stats_t stats();
+
+    // Describes how closely the current (or most recent) job kept to config.cadence_hz
+    bce_cadence_t cadence_report();
+
+    // Returns the number of register trace records that were dropped
+    uint64_t trace_dropped() {return reg_trace_.dropped();}
+
+    // Returns the number of timeline spans that didn't fit in the buffer
+    uint64_t spans_dropped() const {return span_trace_.dropped();}
+
+    // Returns the configured name of the register at the specified offset
+    std::string register_name(uint32_t offset) const;
+
+    // Re-drives recorded register accesses against the register space.  Returns the
+    // elapsed time in nanoseconds
+    double  replay(const std::vector<reg_trace_rec_t>& records);
+
+protected:
+
+    // How the BC_EMU registers are being accessed
+    enum reg_access_t {ACCESS_MMIO, ACCESS_TRACED, ACCESS_COUNTING, ACCESS_MEMORY};
+
+    // Calls fn(registers) with the register block for the current access method.  Code in "fn"
+    // is compiled once for each access method, so a loop inside it has no per-access dispatch
+    template <class F> auto with_registers(F fn)
+    {
+        switch (reg_access_)
+        {
+            case ACCESS_TRACED:   return fn(traced_regs_);
+            case ACCESS_COUNTING: return fn(counting_regs_);
+            case ACCESS_MEMORY:   return fn(memory_regs_);
+            default:              return fn(mmio_regs_);
+        }
+    }
+
+    // Reads and writes a single BC_EMU register
+    uint32_t reg_read(reg_id_t id) {return with_registers([=](auto& regs) {return regs.read(id);});}
+    void    reg_write(reg_id_t id, uint32_t value)
+            {with_registers([=](auto& regs) {regs.write(id, value);});}
+
+    // Returns the start of the register space, or nullptr if there isn't one
+    uint8_t* reg_base() {return with_registers([](auto& regs) {return regs.base();});}
+
+    // In verbose mode with count_registers, shows how often each register was accessed
+    void    show_register_counts();
+
+    // Runs a job or a calibration, stopping the device cleanly if it's aborted
+    bool    run_abortable(void (Feeder::*job)());
+
+    // The bodies of run() and calibrate()
+    void    feed_frames();
+    void    calibrate_pacing();
+
+    // Throws job_aborted if an abort has been requested.  check_abort_request() only looks for
+    // calls to request_abort(), and is safe to call from any thread
+    void    check_abort(bool force = false);
+    void    check_abort_request();
+    [[noreturn]] void abort_job(const char* source, std::chrono::steady_clock::time_point when);
+
+    // Waits for a register to have the specified value
+    void    wait_for_register(reg_id_t reg, uint32_t value, uint32_t poll_us,
+                              const char* what, bool abortable = true, bool interrupt = false);
+
+    // Sets up (and tears down) the epoll set we sleep in while waiting for an interrupt, and
+    // sleeps in it for no more than "timeout_us"
+    void    start_interrupt_wait();
+    void    stop_interrupt_wait();
+    void    wait_for_interrupt(uint32_t timeout_us);
+
+    // With a cadence, waits until the slot for the next FIFO hand-off
+    void    wait_for_slot();
+
+    // The two halves of open_device(): mapping the device, and making sure BC_EMU is ready
+    void    map_device();
+    void    init_device(bool use_profile);
+
+    // Shows how long each startup phase took
+    void    show_startup_report();
+
+    // Starts recording the timeline, if config.trace_file asks for one
+    void    start_span_trace();
+
+    // Device control
+    void    reset_fifos();
+    bool    start_fifo(uint32_t which);
+    void    stop_job();
+    void    load_words(reg_id_t fifo, const uint32_t* data, size_t count,
+                       patch_cursor_t* patch = nullptr);
+    int     stream_words(reg_id_t fifo, reg_id_t level, const uint32_t* data, size_t count,
+                         patch_cursor_t* patch = nullptr);
+    int     get_next_frame_index();
+    bool    get_next_frame(bce_frame_t& frame, int& index, uint32_t& crc);
+
+    // Pacing profiles and calibration
+    std::string profile_filename();
+    void    load_device_profile();
+    bool    calibration_trial(const bce_frame_t& frame);
+    bool    pacing_is_stable(const bce_frame_t& frame, uint32_t delay_us, uint32_t burst_size);
+
+    // A dataset that has been replaced, kept in memory in case it's loaded again
+    struct cached_dataset_t
+    {
+        std::string              stamp;
+        std::vector<bce_frame_t> frame;
+        std::vector<intvec_t>    data;
+        std::vector<MappedFrame> map;
+        std::vector<std::string> name;
+        std::vector<uint32_t>    crc;
+        FrameStore               store;
+        uint64_t                 last_used = 0;
+    };
+
+    // Frame-data housekeeping
+    intvec_t read_frame(const std::string& filename);
+    void    read_frame_data_files();
+    void    read_patch_dataset();
+    void    read_frame_pack();
+    void    start_loading();
+    void    wait_for_frame(int index);
+    bool    take_cached_dataset(const std::string& key, const std::string& stamp);
+    void    swap_dataset(cached_dataset_t& other);
+    void    load_changed_file(file_change_t& change);
+    void    apply_dataset_changes();
+    void    pack_frame_store();
+
+    // Keeps this thread and its memory on the card's NUMA node
+    void    place_on_device_node();
+    void    compute_frame_crcs();
+    void    check_crc_manifest();
+
+    // Throughput prediction
+    double  measure_word_write();
+
+    // This provides memory read/write access to the PCI device we care about
+    PciDevice device_;
+
+    // When we wait on interrupts: the epoll set that holds the device's interrupt and the
+    // control socket, or -1 if we poll instead
+    int     irq_epoll_ = -1;
+
+    // When enabled, this records every access to a BC_EMU register
+    RegTrace reg_trace_;
+
+    // When enabled, this records the timeline of the run
+    SpanTrace span_trace_;
+
+    // The BC_EMU registers, through each of the ways we know how to access them.  Only the one
+    // selected by reg_access_ is attached
+    RegisterBlock<MmioAccess>     mmio_regs_;
+    RegisterBlock<TracedAccess>   traced_regs_;
+    RegisterBlock<CountingAccess> counting_regs_;
+    RegisterBlock<MemoryAccess>   memory_regs_;
+    reg_access_t                  reg_access_ = ACCESS_MMIO;
+
+    // Every frame we send.  Frames read from disk live in frame_data_, binary files that are
+    // sent as they lie are mapped in frame_map_, and frames handed to us by the caller live in
+    // caller memory.  frame_map_ is either empty or has an entry for every frame
+    std::vector<bce_frame_t> frame_;
+    std::vector<intvec_t>    frame_data_;
+    std::vector<MappedFrame> frame_map_;
+
+    // Returns true if frame_[index] is a mapped file
+    bool    frame_is_mapped(size_t index) const
+            {return index < frame_map_.size() && frame_map_[index].mapped();}
+
+    // When frame-data is packed for NUMA or huge pages, this is where it lives
+    FrameStore frame_store_;
+
+    // The NUMA node the card is attached to, or -1 if unknown
+    int     numa_node_ = -1;
+
+    // In watch mode, this re-reads frame-data files that change
+    DirWatcher watcher_;
+
+    // A dataset read from a patch file.  Each entry in frame_ points at its base frame, and
+    // the patches for frame_[n] are described by patch_data_.frame[n].  Empty otherwise
+    patch_dataset_t patch_data_;
+
+    // A frame pack.  When it's open, every entry in frame_ points into it
+    FramePack frame_pack_;
+
+    // The name (usually the filename) and CRC32C of each frame
+    std::vector<std::string> frame_name_;
+    std::vector<uint32_t>    frame_crc_;
+
+    // The files the current dataset was read from, and their sizes and modification times
+    // when it was read.  Empty if the dataset didn't come from files
+    std::string dataset_key_;
+    std::string dataset_stamp_;
+
+    // With progressive loading: the threads reading the dataset, which frames are ready, the
+    // next frame to read, and the error of the lowest-numbered frame that couldn't be read
+    // (guarded by loader_mutex_).  frame_loaded_ is signalled as each frame is ready.
+    // frame_ready_ is null once every frame is ready
+    std::vector<std::thread>             loader_threads_;
+    std::unique_ptr<std::atomic<bool>[]> frame_ready_;
+    std::atomic<size_t>                  next_load_index_{0};
+    std::atomic<size_t>                  frames_loaded_{0};
+    std::atomic<bool>                    loader_stop_{false};
+    std::exception_ptr                   loader_error_;
+    size_t                               loader_failed_index_ = SIZE_MAX;
+    std::mutex                           loader_mutex_;
+    std::condition_variable              frame_loaded_;
+
+    // When the dataset began loading, when its directory (if it has one) was listed, and how
+    // often the feeder had to wait for the loader
+    std::chrono::steady_clock::time_point load_start_time_;
+    std::chrono::steady_clock::time_point dir_scan_start_, dir_scan_end_;
+    uint32_t loader_waits_ = 0;
+
+    // Datasets that have been replaced, keyed by the files they were read from
+    std::map<std::string, std::unique_ptr<cached_dataset_t>> dataset_cache_;
+    uint64_t dataset_loads_ = 0;
+    bool     dataset_cached_ = false;
+
+    // The frame currently being sent, and how many times it has been sent
+    int     current_frame_index_ = 0;
+    int     current_repeat_ = 0;
+
+    // If not null, frames come from here rather than from the dataset
+    FrameSource* source_ = nullptr;
+
+    // The source we create when listening on a socket
+    std::unique_ptr<SocketSource> socket_source_;
+
+    // The source we create when taking frames from a shared-memory ring
+    std::unique_ptr<ShmSource> shm_source_;
+
+    // The last frame we took from the source, its CRC, and the number of frames taken
+    bce_frame_t last_frame_ = {};
+    uint32_t    last_crc_ = 0;
+    int         source_frames_ = 0;
+
+    // The number of bright-cycles completed
+    uint32_t bc_count_ = 0;
+
+    // True if the FIFOs have been reset, and not touched since
+    bool    fifos_reset_ = false;
+
+    // With fifo_retain_mask, the frame each FIFO still holds.  A FIFO that already holds the
+    // next frame is re-armed instead of being reset and reloaded.  "words" = 0 if the FIFO
+    // holds nothing we can reuse
+    struct resident_frame_t
+    {
+        const uint32_t* data;
+        size_t          words;
+        uint32_t        crc;
+    };
+    resident_frame_t resident_[2] = {};
+
+    // Forgets what the FIFOs hold.  Called whenever the FIFOs are reset or the frames they were
+    // loaded from are replaced, so that a stale record can never cause a re-arm
+    void    forget_resident_frames() {resident_[0] = resident_[1] = {};}
+
+    // The startup phases, for the startup report
+    struct startup_phase_t
+    {
+        const char* name;
+        std::chrono::steady_clock::time_point start, end;
+        bool        background;
+    };
+    std::vector<startup_phase_t> startup_phases_;
+
+    // Called at the start of every bright-cycle
+    std::function<void(const bce_bc_info_t&)> callback_;
+
+    // The running totals for the job, and the timeline hand-offs are scheduled against, both
+    // guarded by stats_mutex_
+    bce_stats_t stats_ = {};
+    Cadence     cadence_;
+    std::mutex  stats_mutex_;
+
+    // An abort request from request_abort(), and when it was made (CLOCK_MONOTONIC ns)
+    std::atomic<const char*> abort_request_{nullptr};
+    std::atomic<int64_t>     abort_request_ns_{0};
+
+    // The control channel, and the next time we should poll it and the abort register
+    int     control_socket_ = -1;
+    std::chrono::steady_clock::time_point next_abort_poll_;
+
+    // Where the last abort came from, and how long it took to honor
+    const char* abort_source_ = nullptr;
+    std::chrono::steady_clock::time_point abort_request_time_;
+    int64_t abort_noticed_us_ = 0;
+    int64_t abort_stopped_us_ = 0;
+};
+//=================================================================================================
@@ -0,0 +1,288 @@
+//=================================================================================================
+// frame_pack.cpp - Implements reading and building frame packs
+//=================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include "frame_pack.h"
+#include "crc32c.h"
+using namespace std;
+
+// The pack is used as it lies, so the index has to be laid out the way the file is
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "frame packs are little-endian");
+static_assert(sizeof(pack_entry_t) == 32, "pack_entry_t must match the file");
+static_assert(sizeof(pack_trailer_t) == 40, "pack_trailer_t must match the file");
+
+// The header, and the magic number in the trailer
+static const char     PACK_MAGIC[8]  = {'B', 'C', 'E', 'P', 'A', 'C', 'K', 0};
+static const char     INDEX_MAGIC[8] = {'B', 'C', 'E', 'I', 'N', 'D', 'E', 'X'};
+static const uint32_t PACK_VERSION   = 1;
+static const size_t   HEADER_SIZE    = 16;
+
+// Every frame starts on a boundary of this many bytes
+static const uint64_t FRAME_ALIGN = 64;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// open() - Maps a frame pack and checks that its index describes the file.  The frames
+//          themselves aren't touched, so they stay on disk until they're sent
+//=================================================================================================
+void FramePack::open(string filename)
+{
+    struct stat sb;
+    const char* name = filename.c_str();
+
+    close();
+
+    int fd = ::open(name, O_RDONLY);
+    if (fd < 0) throwRuntime("Can't read %s", name);
+    if (fstat(fd, &sb) < 0)
+    {
+        ::close(fd);
+        throwRuntime("Can't stat %s", name);
+    }
+
+    length_ = sb.st_size;
+    if (length_ < HEADER_SIZE + sizeof(pack_trailer_t))
+    {
+        ::close(fd);
+        throwRuntime("%s is too short to be a frame pack", name);
+    }
+
+    void* ptr = mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) throwRuntime("Can't map %s", name);
+    base_ = (uint8_t*)ptr;
+
+    try
+    {
+        // Check the header
+        uint32_t version;
+        memcpy(&version, base_ + sizeof(PACK_MAGIC), sizeof version);
+        if (memcmp(base_, PACK_MAGIC, sizeof PACK_MAGIC) != 0) throwRuntime("%s isn't a frame pack", name);
+        if (version != PACK_VERSION) throwRuntime("%s is a version %u frame pack", name, version);
+
+        // Check that the trailer's index and names are inside the file
+        pack_trailer_t trailer;
+        uint64_t end = length_ - sizeof(trailer);
+        memcpy(&trailer, base_ + end, sizeof trailer);
+        if (memcmp(trailer.magic, INDEX_MAGIC, sizeof INDEX_MAGIC) != 0)
+        {
+            throwRuntime("%s has no index.  Was it finished?", name);
+        }
+        if (trailer.index_offset < HEADER_SIZE || trailer.index_offset > end
+        ||  trailer.index_offset % sizeof(uint64_t)
+        ||  trailer.frame_count > (end - trailer.index_offset) / sizeof(pack_entry_t)
+        ||  trailer.names_offset > end || trailer.names_bytes > end - trailer.names_offset
+        ||  trailer.names_offset < trailer.index_offset + trailer.frame_count * sizeof(pack_entry_t))
+        {
+            throwRuntime("%s has a damaged index", name);
+        }
+
+        // Check that every frame and name is where it can be
+        index_ = (const pack_entry_t*)(base_ + trailer.index_offset);
+        names_ = (const char*)(base_ + trailer.names_offset);
+        count_ = trailer.frame_count;
+        for (size_t i = 0; i < count_; ++i)
+        {
+            auto& entry = index_[i];
+            if (entry.offset < HEADER_SIZE || entry.offset > trailer.index_offset
+            ||  entry.offset % sizeof(uint32_t)
+            ||  entry.words > (trailer.index_offset - entry.offset) / sizeof(uint32_t)
+            ||  entry.name_offset > trailer.names_bytes
+            ||  entry.name_length > trailer.names_bytes - entry.name_offset)
+            {
+                throwRuntime("%s: index entry %lu is damaged", name, i);
+            }
+        }
+
+        // Frames are found in no particular order, so don't read ahead on our account
+        madvise(base_, length_, MADV_RANDOM);
+    }
+    catch(...)
+    {
+        close();
+        throw;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// close() - Unmaps the file, if one is mapped
+//=================================================================================================
+void FramePack::close()
+{
+    if (base_) munmap(base_, length_);
+    base_   = nullptr;
+    length_ = 0;
+    index_  = nullptr;
+    names_  = nullptr;
+    count_  = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// frame() - Returns the words of a frame, where they lie in the mapping
+//=================================================================================================
+bce_frame_t FramePack::frame(size_t index) const
+{
+    auto& entry = index_[index];
+    return {(const uint32_t*)(base_ + entry.offset), (size_t)entry.words};
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// name() - Returns the name of a frame
+//=================================================================================================
+string FramePack::name(size_t index) const
+{
+    auto& entry = index_[index];
+    return string(names_ + entry.name_offset, entry.name_length);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// prefetch() - Starts reading a frame's pages from disk, without waiting for them
+//=================================================================================================
+void FramePack::prefetch(size_t index) const
+{
+    if (index >= count_) return;
+
+    // madvise() wants a page-aligned start
+    auto&    entry = index_[index];
+    uint64_t page  = sysconf(_SC_PAGESIZE);
+    uint64_t start = entry.offset & ~(page - 1);
+    uint64_t end   = entry.offset + entry.words * sizeof(uint32_t);
+    if (end > start) madvise(base_ + start, end - start, MADV_WILLNEED);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// ~FramePackWriter() - Throws away a pack that was never finished
+//=================================================================================================
+FramePackWriter::~FramePackWriter()
+{
+    if (file_)
+    {
+        fclose(file_);
+        unlink(temp_name_.c_str());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Starts a new pack, under a temporary name
+//=================================================================================================
+void FramePackWriter::create(string filename)
+{
+    if (file_) throwRuntime("A frame pack is already being written");
+
+    filename_  = filename;
+    temp_name_ = filename + ".tmp";
+    file_ = fopen(temp_name_.c_str(), "wb");
+    if (file_ == nullptr) throwRuntime("Can't create %s", temp_name_.c_str());
+
+    offset_ = 0;
+    index_.clear();
+    names_.clear();
+
+    uint32_t header[2] = {PACK_VERSION, 0};
+    write(PACK_MAGIC, sizeof PACK_MAGIC);
+    write(header, sizeof header);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// write() - Writes bytes at the end of the file
+//=================================================================================================
+void FramePackWriter::write(const void* data, size_t length)
+{
+    if (length && fwrite(data, length, 1, file_) != 1) throwRuntime("Can't write %s", temp_name_.c_str());
+    offset_ += length;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// add() - Appends a frame to the pack, on a 64-byte boundary
+//=================================================================================================
+void FramePackWriter::add(const uint32_t* data, size_t words, const string& name)
+{
+    static const uint8_t zeros[FRAME_ALIGN] = {};
+    write(zeros, (FRAME_ALIGN - offset_ % FRAME_ALIGN) % FRAME_ALIGN);
+
+    pack_entry_t entry;
+    entry.offset      = offset_;
+    entry.words       = words;
+    entry.crc         = crc32c(data, words * sizeof(uint32_t));
+    entry.name_length = name.size();
+    entry.name_offset = names_.size();
+    index_.push_back(entry);
+    names_ += name;
+
+    write(data, words * sizeof(uint32_t));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// finish() - Writes the index, the names and the trailer, and renames the pack into place
+//=================================================================================================
+uint64_t FramePackWriter::finish()
+{
+    if (file_ == nullptr) throwRuntime("No frame pack is being written");
+
+    // The index is made of 64-bit fields, so it starts on a 64-bit boundary
+    static const uint8_t zeros[sizeof(uint64_t)] = {};
+    write(zeros, (sizeof(uint64_t) - offset_ % sizeof(uint64_t)) % sizeof(uint64_t));
+
+    pack_trailer_t trailer;
+    trailer.index_offset = offset_;
+    trailer.frame_count  = index_.size();
+    write(index_.data(), index_.size() * sizeof(pack_entry_t));
+    trailer.names_offset = offset_;
+    trailer.names_bytes  = names_.size();
+    write(names_.data(), names_.size());
+    memcpy(trailer.magic, INDEX_MAGIC, sizeof INDEX_MAGIC);
+    write(&trailer, sizeof trailer);
+
+    // Only a pack that's safely on disk takes the real name
+    bool ok = (fflush(file_) == 0) && (fsync(fileno(file_)) == 0);
+    ok = (fclose(file_) == 0) && ok;
+    file_ = nullptr;
+    if (!ok || rename(temp_name_.c_str(), filename_.c_str()) < 0)
+    {
+        unlink(temp_name_.c_str());
+        throwRuntime("Can't write %s", filename_.c_str());
+    }
+
+    return offset_;
+}
+//=================================================================================================
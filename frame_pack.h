@@ -0,0 +1,140 @@
+//=================================================================================================
+// frame_pack.h - Defines a frame pack: a single file that holds many frames, with an index at the
+//                end that says where each one is
+//
+// A dataset of one file per bright-cycle can run to hundreds of thousands of small files, and
+// opening, reading and listing them costs far more than the frame-data itself.  A frame pack is
+// opened once and mapped; a frame is found through the index in O(1), and its pages are only
+// read from disk when the frame is sent.  Everything is little-endian:
+//
+//      header      "BCEPACK" and a NUL, then a uint32_t version (1) and a uint32_t of zero
+//      frames      Each frame's words, starting on a 64-byte boundary
+//      index       A pack_entry_t for each frame
+//      names       The name of each frame, back to back with no terminators
+//      trailer     A pack_trailer_t, which ends the file
+//
+// "bce_feeder -makepack <file>" builds a frame pack from a dataset of CSV, .bin and .npy files
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "bcefeeder.h"
+
+// Where a frame is in the pack.  Offsets are from the start of the file
+struct pack_entry_t
+{
+    uint64_t offset;
+    uint64_t words;
+    uint32_t crc;
+    uint32_t name_length;
+    uint64_t name_offset;
+};
+
+// The end of the file
+struct pack_trailer_t
+{
+    uint64_t index_offset;
+    uint64_t frame_count;
+    uint64_t names_offset;
+    uint64_t names_bytes;
+    char     magic[8];
+};
+
+
+//=================================================================================================
+// FramePack - A frame pack, mapped read-only
+//=================================================================================================
+class FramePack
+{
+public:
+
+    // Constructor and destructor
+    FramePack() {}
+    ~FramePack() {close();}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    FramePack(const FramePack&) = delete;
+    FramePack& operator= (const FramePack&) = delete;
+
+    // Maps a frame pack and checks its index.  None of the frame-data is read.  Throws
+    // runtime_error on failure
+    void    open(std::string filename);
+
+    // Unmaps the file
+    void    close();
+
+    // Returns true if a pack is open
+    bool    is_open() const {return base_ != nullptr;}
+
+    // The number of frames in the pack
+    size_t  size() const {return count_;}
+
+    // The words of a frame, as they lie in the mapping
+    bce_frame_t frame(size_t index) const;
+
+    // The CRC32C of a frame's words, as recorded when the pack was built
+    uint32_t crc(size_t index) const {return index_[index].crc;}
+
+    // The name of a frame (usually the file it was built from)
+    std::string name(size_t index) const;
+
+    // Asks the kernel to start reading a frame from disk, so that it's in memory by the time
+    // it's sent
+    void    prefetch(size_t index) const;
+
+protected:
+
+    // The mapping, its index and names, and the number of frames
+    uint8_t*            base_ = nullptr;
+    size_t              length_ = 0;
+    const pack_entry_t* index_ = nullptr;
+    const char*         names_ = nullptr;
+    size_t              count_ = 0;
+};
+//=================================================================================================
+
+
+//=================================================================================================
+// FramePackWriter - Builds a frame pack one frame at a time.  The pack is written under a
+//                   temporary name, and only takes its real name once it's finished
+//=================================================================================================
+class FramePackWriter
+{
+public:
+
+    // Constructor and destructor.  An unfinished pack is deleted
+    FramePackWriter() {}
+    ~FramePackWriter();
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    FramePackWriter(const FramePackWriter&) = delete;
+    FramePackWriter& operator= (const FramePackWriter&) = delete;
+
+    // Starts a new pack.  Throws runtime_error on failure
+    void    create(std::string filename);
+
+    // Appends a frame.  Throws runtime_error on failure
+    void    add(const uint32_t* data, size_t words, const std::string& name);
+
+    // Writes the index and trailer, and gives the pack its real name.  Returns the size of the
+    // pack in bytes.  Throws runtime_error on failure
+    uint64_t finish();
+
+protected:
+
+    // Writes bytes at the end of the file
+    void    write(const void* data, size_t length);
+
+    // The file, its final name and the name it's written under, and how much has been written
+    FILE*        file_ = nullptr;
+    std::string  filename_, temp_name_;
+    uint64_t     offset_ = 0;
+
+    // The index and names, which are written once every frame has been
+    std::vector<pack_entry_t> index_;
+    std::string               names_;
+};
+//=================================================================================================
@@ -0,0 +1,180 @@
+//=================================================================================================
+// frame_patch.cpp - Implements a dataset in which every frame is a base frame plus a short list of
+//                   words that differ from it
+//=================================================================================================
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <stdexcept>
+#include "frame_patch.h"
+#include "crc32c.h"
+using namespace std;
+namespace fs = std::filesystem;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bytes() - Returns the number of bytes of frame-data in the dataset
+//=================================================================================================
+size_t patch_dataset_t::bytes() const
+{
+    size_t result = patch.size() * sizeof(frame_patch_t) + frame.size() * sizeof(frame_t);
+    for (auto& v : base) result += v.size() * sizeof(uint32_t);
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parse_number() - Parses a decimal or 0x-hex number that must fit in 32 bits
+//
+// Returns: false if "text" isn't such a number
+//=================================================================================================
+static bool parse_number(const char* text, const char* end, uint32_t* value)
+{
+    char* stop;
+    if (text == end) return false;
+    unsigned long long result = strtoull(text, &stop, 0);
+    if (stop != end || result > 0xFFFFFFFF) return false;
+    *value = result;
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_patch_file() - Reads a patch file and the base frames it names
+//=================================================================================================
+patch_dataset_t read_patch_file(string filename, read_method_t method)
+{
+    patch_dataset_t result;
+    map<string, uint32_t> base_index;
+    string line;
+    int    line_number = 0;
+
+    ifstream file(filename);
+    if (!file.is_open()) throwRuntime("Can't read %s", filename.c_str());
+
+    fs::path directory = fs::path(filename).parent_path();
+
+    while (getline(file, line))
+    {
+        ++line_number;
+        istringstream stream(line);
+        string keyword, name;
+        if (!(stream >> keyword) || keyword[0] == '#') continue;
+
+        // A base frame
+        if (keyword == "base")
+        {
+            string csv;
+            if (!(stream >> name >> csv))
+            {
+                throwRuntime("%s line %i: expected 'base <name> <csv-file>'", filename.c_str(), line_number);
+            }
+            if (base_index.count(name))
+            {
+                throwRuntime("%s line %i: base frame '%s' is already declared", filename.c_str(), line_number, name.c_str());
+            }
+
+            fs::path path(csv);
+            if (path.is_relative()) path = directory / path;
+            base_index[name] = result.base.size();
+            result.base.push_back(read_csv_file(path.string(), method));
+            result.base_name.push_back(path.string());
+            continue;
+        }
+
+        // A frame, and its patches
+        if (keyword == "frame")
+        {
+            if (!(stream >> name)) throwRuntime("%s line %i: expected 'frame <base-name>'", filename.c_str(), line_number);
+            auto it = base_index.find(name);
+            if (it == base_index.end())
+            {
+                throwRuntime("%s line %i: unknown base frame '%s'", filename.c_str(), line_number, name.c_str());
+            }
+
+            patch_dataset_t::frame_t frame = {it->second, (uint32_t)result.patch.size(), 0};
+            size_t base_size = result.base[frame.base].size();
+
+            string patch;
+            while (stream >> patch)
+            {
+                frame_patch_t p;
+                const char* text   = patch.c_str();
+                const char* equals = strchr(text, '=');
+                if (equals == nullptr
+                ||  !parse_number(text, equals, &p.index)
+                ||  !parse_number(equals + 1, text + patch.size(), &p.value))
+                {
+                    throwRuntime("%s line %i: invalid patch '%s'", filename.c_str(), line_number, text);
+                }
+                if (p.index >= base_size)
+                {
+                    throwRuntime("%s line %i: index %u is beyond the end of base frame '%s'",
+                                 filename.c_str(), line_number, p.index, name.c_str());
+                }
+                if (frame.patch_count && p.index <= result.patch.back().index)
+                {
+                    throwRuntime("%s line %i: patch indices must be in ascending order", filename.c_str(), line_number);
+                }
+                result.patch.push_back(p);
+                ++frame.patch_count;
+            }
+
+            result.frame.push_back(frame);
+            continue;
+        }
+
+        throwRuntime("%s line %i: unknown keyword '%s'", filename.c_str(), line_number, keyword.c_str());
+    }
+
+    if (result.frame.empty()) throwRuntime("%s contains no frames", filename.c_str());
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// patched_frame_crc() - Computes the CRC32C of a frame with its patches applied, one run of
+//                       unpatched words at a time
+//=================================================================================================
+uint32_t patched_frame_crc(const patch_dataset_t& dataset, size_t frame_index)
+{
+    auto&           frame = dataset.frame[frame_index];
+    const intvec_t& base  = dataset.base[frame.base];
+    uint32_t        crc   = 0;
+    size_t          index = 0;
+
+    for (uint32_t i = 0; i < frame.patch_count; ++i)
+    {
+        auto& patch = dataset.patch[frame.first_patch + i];
+        crc = crc32c(base.data() + index, (patch.index - index) * sizeof(uint32_t), crc);
+        crc = crc32c(&patch.value, sizeof(uint32_t), crc);
+        index = patch.index + 1;
+    }
+
+    return crc32c(base.data() + index, (base.size() - index) * sizeof(uint32_t), crc);
+}
+//=================================================================================================
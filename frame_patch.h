@@ -0,0 +1,65 @@
+//=================================================================================================
+// frame_patch.h - Defines a dataset in which every frame is a base frame plus a short list of
+//                 words that differ from it
+//
+// A patch file is text.  Blank lines and lines that start with '#' are ignored, and every other
+// line is one of:
+//
+//      base <name> <csv-file>                  Declares a base frame, read from a CSV file.  A
+//                                              relative filename is relative to the directory
+//                                              the patch file is in
+//
+//      frame <base-name> [<index>=<value> ...] Adds a frame: the named base frame, with the word
+//                                              at each <index> replaced by <value>
+//
+// Indices and values are decimal, or hex with a leading "0x".  A frame's indices must be in
+// ascending order, and within its base frame
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "frame_reader.h"
+
+// A word of a frame that differs from its base frame
+struct frame_patch_t
+{
+    uint32_t index;
+    uint32_t value;
+};
+
+// A dataset of base frames and patches
+struct patch_dataset_t
+{
+    // A frame: its base frame, and the range of "patch" that applies to it
+    struct frame_t
+    {
+        uint32_t base;
+        uint32_t first_patch;
+        uint32_t patch_count;
+    };
+
+    std::vector<intvec_t>      base;
+    std::vector<std::string>   base_name;
+    std::vector<frame_patch_t> patch;
+    std::vector<frame_t>       frame;
+
+    // Returns the number of bytes of frame-data this holds
+    size_t  bytes() const;
+};
+
+// While a frame is being loaded, this tracks the patches that haven't been written yet, and the
+// index (within the frame) of the next word to be written
+struct patch_cursor_t
+{
+    const frame_patch_t* next;
+    const frame_patch_t* end;
+    size_t               index;
+};
+
+// Reads a patch file.  Throws runtime_error on failure
+patch_dataset_t read_patch_file(std::string filename, read_method_t method = READ_MMAP);
+
+// Computes the CRC32C of a frame, as it is after its patches are applied
+uint32_t patched_frame_crc(const patch_dataset_t& dataset, size_t frame_index);
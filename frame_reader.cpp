@@ -0,0 +1,576 @@
+//=================================================================================================
+// frame_reader.cpp - Implements routines that parse frame-data files into vectors of integers
+//=================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdexcept>
+#include <utility>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "frame_reader.h"
+using namespace std;
+
+// Binary frame-data files hold little-endian words, and we use them as they lie
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "binary frame-data requires a little-endian CPU");
+
+// When parsing from a memory-mapped file, this is how many bytes we parse before
+// unmapping the portion of the file that we've already consumed
+static const size_t MMAP_CHUNK_SIZE = 4 * 1024 * 1024;
+
+// This is the size of the block we read at a time when using pread()
+static const size_t PREAD_BLOCK_SIZE = 1024 * 1024;
+
+// parse_csv_lines() reports this when lines have different numbers of values
+static const size_t COLUMNS_DIFFER = SIZE_MAX;
+
+// A typical entry in a frame-data file is "0x00000000\n".  We use this to guess
+// how many values a file contains so that the result vector is allocated only once
+static const size_t TYPICAL_BYTES_PER_VALUE = 11;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// is_ws() - Returns true if the character is a space or tab
+//=================================================================================================
+static inline bool is_ws(char c) {return c == 32 || c == 9;}
+//=================================================================================================
+
+
+//=================================================================================================
+// is_eol() - Returns true if the character is an end-of-line character
+//=================================================================================================
+static inline bool is_eol(char c) {return c == 10 || c == 13 || c == 0;}
+//=================================================================================================
+
+
+//=================================================================================================
+// parse_value() - Parses an integer in the same manner as strtoul(p, nullptr, 0), but never
+//                 looks at any character at or beyond "end".  This means we can parse directly
+//                 out of a memory-mapped file that isn't nul-terminated
+//
+// Returns: The parsed value
+//=================================================================================================
+static uint32_t parse_value(const char* p, const char* end)
+{
+    uint64_t value = 0;
+    bool     negative = false;
+
+    // Handle an optional sign
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+    // Is this a hexadecimal value?
+    if (p + 2 < end && p[0] == '0' && (p[1] | 32) == 'x' && isxdigit(p[2]))
+    {
+        for (p += 2; p < end; ++p)
+        {
+            int c = *p;
+            if      (c >= '0' && c <= '9') value = (value << 4) | (c - '0');
+            else if ((c | 32) >= 'a' && (c | 32) <= 'f') value = (value << 4) | ((c | 32) - 'a' + 10);
+            else break;
+        }
+    }
+
+    // Is this an octal value?
+    else if (p < end && *p == '0')
+    {
+        for (++p; p < end && *p >= '0' && *p <= '7'; ++p) value = (value << 3) | (*p - '0');
+    }
+
+    // Otherwise, it's decimal
+    else
+    {
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) value = value * 10 + (*p - '0');
+    }
+
+    // Hand the caller the value
+    return (uint32_t)(negative ? -value : value);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parse_csv_lines() - Parses lines of CSV text and appends every value found to "result".
+//                     Values can be in hex or decimal, and can be comma separated into lines of
+//                     arbitrary length.  Blank lines and comment lines beginning with either
+//                     "#" or "//" are ignored.
+//
+// Passed: p       = Pointer to the first character of the text
+//         end     = Pointer to one past the last character of the text
+//         result  = The vector where parsed values get appended
+//         columns = If not null, the number of values on each line.  0 = no line has been
+//                   parsed yet, and COLUMNS_DIFFER = two lines had different numbers of values
+//
+// Notes: "end" is always treated as the end of a line, so the caller must never hand us
+//        a buffer that splits a line in two
+//=================================================================================================
+void parse_csv_lines(const char* p, const char* end, intvec_t& result, size_t* columns)
+{
+    while (p < end)
+    {
+        // Find the end of this line
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (eol == nullptr) eol = end;
+
+        // Skip over any leading whitespace
+        while (p < eol && is_ws(*p)) ++p;
+
+        // If the line is a "//" or "#" comment, skip it
+        bool is_comment = (p < eol && *p == '#') || (p + 1 < eol && p[0] == '/' && p[1] == '/');
+        size_t line_start = result.size();
+
+        // This loop parses out comma-separated fields
+        while (!is_comment)
+        {
+            // Skip over leading whitespace
+            while (p < eol && is_ws(*p)) ++p;
+
+            // If we've found the end of the line, we're done
+            if (p == eol || is_eol(*p)) break;
+
+            // Extract this value from the text and append it to our result vector
+            result.push_back(parse_value(p, eol));
+
+            // Point to the character after the next comma, or to the end of the line
+            while (p < eol && *p != ',' && !is_eol(*p)) ++p;
+            if (p < eol && *p == ',') ++p;
+        }
+
+        // Keep track of how many values there are on each line that has any
+        size_t count = result.size() - line_start;
+        if (columns && count && *columns != count) *columns = (*columns == 0) ? count : COLUMNS_DIFFER;
+
+        // Point to the start of the next line
+        p = eol + 1;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_via_pread() - Reads and parses a CSV file using large pread() blocks.  This is the
+//                    fallback for filesystems on which memory-mapping performs poorly
+//=================================================================================================
+static void read_via_pread(int fd, const string& filename, intvec_t& result, size_t* columns)
+{
+    vector<char> buffer(PREAD_BLOCK_SIZE);
+    off_t        offset = 0;
+    size_t       carry  = 0;
+
+    // Tell the kernel we're going to read this file front to back
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    while (true)
+    {
+        // If a single line won't fit in the buffer, make the buffer bigger
+        if (carry == buffer.size()) buffer.resize(buffer.size() * 2);
+
+        // Read the next block of the file, appended to whatever partial line we're carrying
+        ssize_t count = pread(fd, buffer.data() + carry, buffer.size() - carry, offset);
+        if (count < 0) throwRuntime("can't read %s", filename.c_str());
+
+        // At end-of-file, parse whatever is left over and we're done
+        if (count == 0)
+        {
+            parse_csv_lines(buffer.data(), buffer.data() + carry, result, columns);
+            return;
+        }
+
+        // Keep track of where the next block comes from
+        offset += count;
+        char* data_end = buffer.data() + carry + count;
+
+        // Find the end of the last complete line in the buffer
+        char* last_lf = (char*)memrchr(buffer.data(), '\n', data_end - buffer.data());
+
+        // If there is no complete line in the buffer yet, go read some more
+        if (last_lf == nullptr)
+        {
+            carry = data_end - buffer.data();
+            continue;
+        }
+
+        // Parse all of the complete lines
+        parse_csv_lines(buffer.data(), last_lf + 1, result, columns);
+
+        // Move the trailing partial line to the front of the buffer
+        carry = data_end - (last_lf + 1);
+        memmove(buffer.data(), last_lf + 1, carry);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_via_mmap() - Memory maps a CSV file and parses it directly from the mapping, unmapping
+//                   the parts of the file that we've finished with as we go
+//
+// Returns: false if the file couldn't be mapped (in which case "result" is untouched)
+//=================================================================================================
+static bool read_via_mmap(int fd, size_t file_size, intvec_t& result, size_t* columns)
+{
+    const long page_size = sysconf(_SC_PAGESIZE);
+
+    // Map the entire file into our address space
+    void* ptr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) return false;
+
+    // Tell the kernel that we're about to read the whole file front to back
+    madvise(ptr, file_size, MADV_SEQUENTIAL);
+    madvise(ptr, file_size, MADV_WILLNEED);
+
+    // These describe the portion of the mapping that is still mapped
+    char* map_base = (char*)ptr;
+    char* map_end  = map_base + file_size;
+
+    // This is where we are currently parsing
+    const char* p = map_base;
+
+    while (p < map_end)
+    {
+        // Find the end of this chunk, rounded out to the end of a line
+        const char* chunk_end = map_end;
+        if (map_end - p > MMAP_CHUNK_SIZE)
+        {
+            chunk_end = (const char*)memchr(p + MMAP_CHUNK_SIZE, '\n', map_end - p - MMAP_CHUNK_SIZE);
+            chunk_end = chunk_end ? chunk_end + 1 : map_end;
+        }
+
+        // Parse every line in this chunk
+        parse_csv_lines(p, chunk_end, result, columns);
+        p = chunk_end;
+
+        // Unmap the whole pages that we've finished parsing
+        char* release_end = map_base + ((p - map_base) / page_size) * page_size;
+        if (release_end > map_base)
+        {
+            munmap(map_base, release_end - map_base);
+            map_base = release_end;
+        }
+    }
+
+    // Unmap whatever remains of the mapping
+    if (map_end > map_base) munmap(map_base, map_end - map_base);
+
+    // Tell the caller that all is well
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parse_read_method() - Converts the name of a read-method into a read_method_t
+//=================================================================================================
+read_method_t parse_read_method(string name)
+{
+    if (name == "mmap" ) return READ_MMAP;
+    if (name == "pread") return READ_PREAD;
+    throwRuntime("Invalid read method '%s'", name.c_str());
+    return READ_MMAP;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_csv_file() - Reads a CSV file full of integers and returns a vector containing them.
+//                   See parse_csv_lines() for a description of the file format
+//
+// Passed: filename = The name of the file to read
+//         method   = READ_MMAP or READ_PREAD
+//         columns  = If not null, this receives the number of values on each line
+//
+// Will throw std::runtime error if file doesn't exist, or if "columns" isn't null and the
+// lines have different numbers of values
+//=================================================================================================
+intvec_t read_csv_file(string filename, read_method_t method, size_t* columns)
+{
+    intvec_t    result;
+    struct stat sb;
+
+    // No line has been parsed yet
+    if (columns) *columns = 0;
+
+    // Try to open the input file, and complain if we can't
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throwRuntime("can't read %s", filename.c_str());
+
+    // Find out how big the file is
+    if (fstat(fd, &sb) < 0)
+    {
+        ::close(fd);
+        throwRuntime("can't stat %s", filename.c_str());
+    }
+
+    // Make a guess at how many values this file contains
+    result.reserve(sb.st_size / TYPICAL_BYTES_PER_VALUE + 1);
+
+    try
+    {
+        // An empty file contains no values (and can't be memory-mapped)
+        if (sb.st_size == 0)
+            ;
+
+        // If we're supposed to memory map the file and that works, we're done
+        else if (method == READ_MMAP && read_via_mmap(fd, sb.st_size, result, columns))
+            ;
+
+        // Otherwise, read the file in big blocks
+        else
+            read_via_pread(fd, filename, result, columns);
+    }
+    catch(...)
+    {
+        ::close(fd);
+        throw;
+    }
+
+    // We're done with the file
+    ::close(fd);
+
+    // If the caller cares about columns, every line must have the same number
+    if (columns && *columns == COLUMNS_DIFFER)
+    {
+        throwRuntime("%s has lines with different numbers of columns", filename.c_str());
+    }
+
+    // Hand the resulting vector to the caller
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// has_extension() - Returns true if "filename" ends with "extension"
+//=================================================================================================
+static bool has_extension(const string& filename, const char* extension)
+{
+    size_t length = strlen(extension);
+    return filename.size() >= length && filename.compare(filename.size() - length, length, extension) == 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// is_binary_frame_file() - Returns true if a file is a .bin or .npy frame-data file
+//=================================================================================================
+bool is_binary_frame_file(const string& filename)
+{
+    return has_extension(filename, ".bin") || has_extension(filename, ".npy");
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_frame_file() - Reads a frame-data file of any kind into a vector.  Binary files are
+//                     mapped and copied
+//=================================================================================================
+intvec_t read_frame_file(string filename, read_method_t method)
+{
+    if (!is_binary_frame_file(filename)) return read_csv_file(filename, method);
+
+    MappedFrame frame;
+    frame.map(filename);
+    return intvec_t(frame.data(), frame.data() + frame.size());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// npy_field() - Finds the value of a field in the header of a .npy file, which is the text of
+//               a Python dict, e.g. "{'descr': '<u4', 'fortran_order': False, 'shape': (4592,), }"
+//
+// Returns: The text of the value, up to the next ',' that isn't inside parentheses, or an empty
+//          string if the field isn't there
+//=================================================================================================
+static string npy_field(const string& header, const char* name)
+{
+    size_t p = header.find(string("'") + name + "'");
+    if (p == string::npos) return "";
+    p = header.find(':', p);
+    if (p == string::npos) return "";
+
+    // Skip the spaces, and stop at the end of the value
+    while (++p < header.size() && is_ws(header[p]));
+    size_t end = p;
+    for (int depth = 0; end < header.size(); ++end)
+    {
+        if (header[end] == '(') ++depth;
+        if (header[end] == ')') --depth;
+        if ((header[end] == ',' && depth == 0) || header[end] == '}') break;
+    }
+    return header.substr(p, end - p);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parse_npy_header() - Checks the header of a .npy file, and finds its words
+//
+// Passed:  filename = The name of the file, for error messages
+//          p, size  = The file's contents
+//
+// On Exit: offset   = The offset of the first word in the file
+//          words    = The number of words in the array
+//=================================================================================================
+static void parse_npy_header(const string& filename, const uint8_t* p, size_t size,
+                             size_t& offset, size_t& words)
+{
+    const char* name = filename.c_str();
+
+    // The file starts with a magic string, a version, and the length of the header.  Version 1
+    // has a 16-bit length, and later versions a 32-bit length
+    if (size < 10 || memcmp(p, "\x93NUMPY", 6) != 0) throwRuntime("%s isn't a .npy file", name);
+    uint32_t major = p[6], length;
+    if (major == 1)
+    {
+        length = p[8] | (p[9] << 8);
+        offset = 10;
+    }
+    else if ((major == 2 || major == 3) && size >= 12)
+    {
+        length = p[8] | (p[9] << 8) | (p[10] << 16) | ((uint32_t)p[11] << 24);
+        offset = 12;
+    }
+    else throwRuntime("%s is .npy version %u, which isn't supported", name, major);
+
+    if (offset + length > size) throwRuntime("%s has a truncated .npy header", name);
+    string header((const char*)p + offset, length);
+    offset += length;
+
+    // The words must be 32-bit, little-endian integers.  '=' is native, and we're little-endian
+    string descr = npy_field(header, "descr");
+    if (descr.size() < 5) throwRuntime("%s has no dtype", name);
+    descr = descr.substr(1, descr.size() - 2);
+    if (descr[0] == '>') throwRuntime("%s is big-endian (dtype '%s')", name, descr.c_str());
+    if ((descr[0] != '<' && descr[0] != '=') || (descr.substr(1) != "u4" && descr.substr(1) != "i4"))
+    {
+        throwRuntime("%s has dtype '%s', but frame-data must be '<u4' or '<i4'", name, descr.c_str());
+    }
+
+    // The shape is a tuple of dimensions.  The words are sent in the order they're stored, so
+    // an array in Fortran order is only usable if it has a single dimension that matters
+    string shape = npy_field(header, "shape");
+    if (shape.empty() || shape[0] != '(') throwRuntime("%s has no shape", name);
+
+    words = 1;
+    int dimensions = 0;
+    for (const char* q = shape.c_str() + 1; *q && *q != ')'; )
+    {
+        if (!isdigit(*q)) {++q; continue;}
+        char* end;
+        size_t dimension = strtoull(q, &end, 10);
+        words *= dimension;
+        if (dimension > 1) ++dimensions;
+        q = end;
+    }
+
+    if (npy_field(header, "fortran_order") == "True" && dimensions > 1)
+    {
+        throwRuntime("%s is in Fortran order; save it in C order", name);
+    }
+
+    // The words must all be there, and aligned
+    if (offset % sizeof(uint32_t)) throwRuntime("%s has misaligned data", name);
+    if (words > (size - offset) / sizeof(uint32_t))
+    {
+        throwRuntime("%s holds fewer words than its shape %s calls for", name, shape.c_str());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// map() - Maps a binary frame-data file read-only, and finds its words.  A .bin file is nothing
+//         but words; a .npy file has a header that describes them
+//=================================================================================================
+void MappedFrame::map(string filename)
+{
+    struct stat sb;
+
+    unmap();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throwRuntime("can't read %s", filename.c_str());
+    if (fstat(fd, &sb) < 0)
+    {
+        ::close(fd);
+        throwRuntime("can't stat %s", filename.c_str());
+    }
+
+    // An empty .bin file is an empty frame (and can't be mapped)
+    bool npy = has_extension(filename, ".npy");
+    if (sb.st_size == 0 && !npy)
+    {
+        ::close(fd);
+        return;
+    }
+
+    void* ptr = (sb.st_size == 0) ? MAP_FAILED : mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) throwRuntime("can't map %s", filename.c_str());
+
+    base_   = ptr;
+    length_ = sb.st_size;
+
+    try
+    {
+        size_t offset = 0, words = length_ / sizeof(uint32_t);
+        if (npy)
+            parse_npy_header(filename, (const uint8_t*)base_, length_, offset, words);
+        else if (length_ % sizeof(uint32_t))
+            throwRuntime("%s isn't a whole number of 32-bit words", filename.c_str());
+
+        data_ = (const uint32_t*)((const uint8_t*)base_ + offset);
+        size_ = words;
+    }
+    catch(...)
+    {
+        unmap();
+        throw;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// unmap() - Unmaps the file, if one is mapped
+//=================================================================================================
+void MappedFrame::unmap()
+{
+    if (base_) munmap(base_, length_);
+    base_   = nullptr;
+    length_ = 0;
+    data_   = nullptr;
+    size_   = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// swap() - Exchanges two mappings
+//=================================================================================================
+void MappedFrame::swap(MappedFrame& other)
+{
+    std::swap(base_,   other.base_);
+    std::swap(length_, other.length_);
+    std::swap(data_,   other.data_);
+    std::swap(size_,   other.size_);
+}
+//=================================================================================================
@@ -0,0 +1,84 @@
+//=================================================================================================
+// frame_reader.h - Defines routines that parse frame-data files into vectors of integers
+//
+// A frame-data file is either CSV text, or a binary file of little-endian 32-bit words: raw
+// (".bin"), or a NumPy array of dtype uint32 or int32 (".npy").  Binary files can be mapped and
+// sent straight from the page cache, without being copied
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A vector of 32-bit integers.  One of these holds the frame-data for a bright-cycle
+typedef std::vector<uint32_t> intvec_t;
+
+// These are the ways we know how to pull a frame-data file off of the disk
+enum read_method_t
+{
+    READ_MMAP,      // Memory map the file and parse directly from the mapping
+    READ_PREAD      // Read the file in large blocks via pread()
+};
+
+// Converts a read-method name (i.e., "mmap" or "pread") into a read_method_t
+read_method_t parse_read_method(std::string name);
+
+// Parses the lines of CSV text in [p, end) and appends each value to "result".  If "columns"
+// isn't null, it tracks the number of values per line (see parse_csv_lines())
+void parse_csv_lines(const char* p, const char* end, intvec_t& result, size_t* columns = nullptr);
+
+// Reads a CSV file full of integers and returns a vector containing them.  If "columns" isn't
+// null, every line must have the same number of values, and that number is stored there
+intvec_t read_csv_file(std::string filename, read_method_t method = READ_MMAP,
+                       size_t* columns = nullptr);
+
+// Returns true if a file is a binary frame-data file (.bin or .npy) rather than CSV
+bool is_binary_frame_file(const std::string& filename);
+
+// Reads a frame-data file of any kind and returns a vector containing its words
+intvec_t read_frame_file(std::string filename, read_method_t method = READ_MMAP);
+
+
+//=================================================================================================
+// MappedFrame - A binary frame-data file, mapped read-only.  The words are used where they lie
+//=================================================================================================
+class MappedFrame
+{
+public:
+
+    // Constructors and destructor
+    MappedFrame() {}
+    MappedFrame(MappedFrame&& other) {swap(other);}
+    ~MappedFrame() {unmap();}
+
+    // Objects of this class can be moved, but not copied
+    MappedFrame(const MappedFrame&) = delete;
+    MappedFrame& operator= (const MappedFrame&) = delete;
+    MappedFrame& operator= (MappedFrame&& other) {unmap(); swap(other); return *this;}
+
+    // Maps a .bin or .npy file, after checking that it holds 32-bit little-endian words.
+    // Throws runtime_error on failure
+    void    map(std::string filename);
+
+    // Unmaps the file
+    void    unmap();
+
+    // Returns true if a file is mapped
+    bool    mapped() const {return base_ != nullptr;}
+
+    // The words in the file
+    const uint32_t* data() const {return data_;}
+    size_t  size() const {return size_;}
+
+    // Exchanges two mappings
+    void    swap(MappedFrame& other);
+
+protected:
+
+    // The whole mapping, and the words within it
+    void*           base_ = nullptr;
+    size_t          length_ = 0;
+    const uint32_t* data_ = nullptr;
+    size_t          size_ = 0;
+};
+//=================================================================================================
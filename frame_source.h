@@ -0,0 +1,45 @@
+//=================================================================================================
+// frame_source.h - Defines the interface to a live source of frames, such as a producer process
+//                  that computes them while the job is running
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include "bcefeeder.h"
+
+// What a frame source has to say when it's asked for a frame
+enum frame_status_t
+{
+    FRAME_READY,        // Here is the next frame
+    FRAME_EMPTY,        // There's no frame available yet
+    FRAME_END           // There will never be another frame
+};
+
+// What the feeder does when a frame source has no frame ready
+enum dry_policy_t
+{
+    DRY_REPEAT,         // Send the previous frame again
+    DRY_WAIT,           // Wait for the next frame, even if the RTL runs out of data
+    DRY_STOP            // End the job
+};
+
+// Converts "repeat", "wait" or "stop" to a dry_policy_t.  Throws runtime_error if it's invalid
+dry_policy_t parse_dry_policy(std::string name);
+
+
+//=================================================================================================
+// FrameSource - The interface between the feeder and a live source of frames
+//=================================================================================================
+class FrameSource
+{
+public:
+
+    virtual ~FrameSource() {}
+
+    // Fetches the next frame to send, waiting up to "wait_us" microseconds for one to become
+    // available.  A frame that is handed out must remain valid and unchanged until the next
+    // call that returns FRAME_READY.  Frames that should be sent more than once are simply
+    // handed out more than once
+    virtual frame_status_t next_frame(bce_frame_t& frame, uint32_t wait_us) = 0;
+};
+//=================================================================================================
@@ -0,0 +1,241 @@
+//=================================================================================================
+// frame_transform.cpp - Implements a chain of transforms that are applied to frame-data at
+//                       load time
+//
+// The kernels are written with GCC vector extensions, so they compile to SSE2 on x86 and to
+// NEON on ARM without any platform-specific code
+//=================================================================================================
+#include <string.h>
+#include <stdarg.h>
+#include <stdexcept>
+#include "frame_transform.h"
+#include "config_file.h"
+#include "parallel.h"
+using namespace std;
+
+// Four 32-bit words that are operated on as a unit
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// for_each_word() - Replaces every word in a frame with the result of a kernel function.
+//                   Four words at a time are handed to "vector_fn", and any left over at the
+//                   end of the frame are handed one at a time to "scalar_fn"
+//=================================================================================================
+template <class VF, class SF>
+static void for_each_word(uint32_t* p, size_t count, VF vector_fn, SF scalar_fn)
+{
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        v4u32 v;
+        memcpy(&v, p + i, sizeof v);
+        v = vector_fn(v);
+        memcpy(p + i, &v, sizeof v);
+    }
+
+    for (; i < count; ++i) p[i] = scalar_fn(p[i]);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bswap() - Reverses the byte order of each 32-bit word
+//=================================================================================================
+template <class T> static inline T bswap(T x)
+{
+    return (x << 24) | ((x & 0xFF00) << 8) | ((x >> 8) & 0xFF00) | (x >> 24);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// remap_lanes() - Within each group of lanes.size() words, output word i is input word lanes[i].
+//                 A partial group at the end of the frame is left untouched
+//=================================================================================================
+static void remap_lanes(uint32_t* p, size_t count, const vector<uint32_t>& lanes)
+{
+    const size_t group = lanes.size();
+
+    // A group of four words is a single vector shuffle
+    if (group == 4)
+    {
+        const v4u32 mask = {lanes[0], lanes[1], lanes[2], lanes[3]};
+        for (size_t i = 0; i + 4 <= count; i += 4)
+        {
+            v4u32 v;
+            memcpy(&v, p + i, sizeof v);
+            v = __builtin_shuffle(v, mask);
+            memcpy(p + i, &v, sizeof v);
+        }
+        return;
+    }
+
+    // Any other group size is done a word at a time
+    vector<uint32_t> temp(group);
+    for (size_t i = 0; i + group <= count; i += group)
+    {
+        for (size_t j = 0; j < group; ++j) temp[j] = p[i + lanes[j]];
+        memcpy(p + i, temp.data(), group * sizeof(uint32_t));
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parse() - Builds the transform chain from a script-spec.  Each line of the script is one
+//           transform, and the transforms are applied in the order they appear:
+//
+//              or     <value>          : word |= value
+//              and    <value>          : word &= value
+//              xor    <value>          : word ^= value
+//              add    <value>          : word += value
+//              shl    <bits>           : word <<= bits
+//              shr    <bits>           : word >>= bits
+//              bswap                   : reverse the byte order of each word
+//              offset <base> <step>    : word += base + step * (index of the frame's file)
+//              lanes  <i0> <i1> ...    : within each group of N words, word[n] = word[i<n>]
+//=================================================================================================
+void FrameTransform::parse(CConfigScript& script)
+{
+    int token_count;
+
+    step_.clear();
+
+    while (script.get_next_line(&token_count))
+    {
+        step_t step = {};
+        string name = script.get_next_token(true);
+
+        if      (name == "or"    ) step.op = OP_OR;
+        else if (name == "and"   ) step.op = OP_AND;
+        else if (name == "xor"   ) step.op = OP_XOR;
+        else if (name == "add"   ) step.op = OP_ADD;
+        else if (name == "shl"   ) step.op = OP_SHL;
+        else if (name == "shr"   ) step.op = OP_SHR;
+        else if (name == "bswap" ) step.op = OP_BSWAP;
+        else if (name == "offset") step.op = OP_OFFSET;
+        else if (name == "lanes" ) step.op = OP_LANES;
+        else throwRuntime("Unknown transform '%s'", name.c_str());
+
+        // Lane remapping takes a list of lane indices
+        if (step.op == OP_LANES)
+        {
+            for (int i=1; i<token_count; ++i) step.lanes.push_back(script.get_next_int());
+            for (auto lane : step.lanes)
+            {
+                if (lane >= step.lanes.size()) throwRuntime("Invalid lane %u in transform", lane);
+            }
+            if (step.lanes.empty()) throwRuntime("'lanes' transform needs a list of lanes");
+        }
+
+        // Everything else takes up to two integer arguments
+        else
+        {
+            step.arg1 = script.get_next_int();
+            step.arg2 = script.get_next_int();
+        }
+
+        // Shifting by 32 bits or more isn't meaningful
+        if ((step.op == OP_SHL || step.op == OP_SHR) && step.arg1 > 31)
+        {
+            throwRuntime("Invalid shift of %u bits in transform", step.arg1);
+        }
+
+        step_.push_back(step);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// apply() - Applies every transform in the chain to a single frame
+//
+// Passed: frame       = The frame-data to transform in place
+//         frame_index = The index of the file this frame was read from
+//=================================================================================================
+void FrameTransform::apply(intvec_t& frame, uint32_t frame_index) const
+{
+    uint32_t* p = frame.data();
+    size_t    n = frame.size();
+
+    for (auto& step : step_)
+    {
+        const uint32_t a = step.arg1, b = step.arg2;
+
+        switch (step.op)
+        {
+            case OP_OR:
+                for_each_word(p, n, [a](v4u32 v) {return v | a;}, [a](uint32_t v) {return v | a;});
+                break;
+
+            case OP_AND:
+                for_each_word(p, n, [a](v4u32 v) {return v & a;}, [a](uint32_t v) {return v & a;});
+                break;
+
+            case OP_XOR:
+                for_each_word(p, n, [a](v4u32 v) {return v ^ a;}, [a](uint32_t v) {return v ^ a;});
+                break;
+
+            case OP_ADD:
+                for_each_word(p, n, [a](v4u32 v) {return v + a;}, [a](uint32_t v) {return v + a;});
+                break;
+
+            case OP_SHL:
+                for_each_word(p, n, [a](v4u32 v) {return v << a;}, [a](uint32_t v) {return v << a;});
+                break;
+
+            case OP_SHR:
+                for_each_word(p, n, [a](v4u32 v) {return v >> a;}, [a](uint32_t v) {return v >> a;});
+                break;
+
+            case OP_BSWAP:
+                for_each_word(p, n, bswap<v4u32>, bswap<uint32_t>);
+                break;
+
+            case OP_OFFSET:
+            {
+                const uint32_t offset = a + b * frame_index;
+                for_each_word
+                (
+                    p, n, [offset](v4u32 v) {return v + offset;},
+                    [offset](uint32_t v) {return v + offset;}
+                );
+                break;
+            }
+
+            case OP_LANES:
+                remap_lanes(p, n, step.lanes);
+                break;
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// apply() - Applies every transform in the chain to every frame, spread across all CPUs
+//=================================================================================================
+void FrameTransform::apply(vector<intvec_t>& frames) const
+{
+    if (empty()) return;
+    parallel_for(frames.size(), [&](size_t index) {apply(frames[index], index);});
+}
+//=================================================================================================
@@ -0,0 +1,44 @@
+//=================================================================================================
+// frame_transform.h - Defines a chain of transforms that are applied to frame-data at load time
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "frame_reader.h"
+
+class CConfigScript;
+
+class FrameTransform
+{
+public:
+
+    // Builds the transform chain from a script-spec in the configuration file
+    void    parse(CConfigScript& script);
+
+    // Returns true if there are no transforms in the chain
+    bool    empty() const {return step_.empty();}
+
+    // Applies every transform in the chain to a single frame
+    void    apply(intvec_t& frame, uint32_t frame_index) const;
+
+    // Applies every transform in the chain to every frame, in parallel
+    void    apply(std::vector<intvec_t>& frames) const;
+
+protected:
+
+    // These are the operations a transform can perform
+    enum op_t {OP_OR, OP_AND, OP_XOR, OP_ADD, OP_SHL, OP_SHR, OP_BSWAP, OP_OFFSET, OP_LANES};
+
+    // A single step in the transform chain
+    struct step_t
+    {
+        op_t                  op;
+        uint32_t              arg1;
+        uint32_t              arg2;
+        std::vector<uint32_t> lanes;
+    };
+
+    // The transforms, in the order they are applied
+    std::vector<step_t> step_;
+};
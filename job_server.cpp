@@ -0,0 +1,450 @@
+//=================================================================================================
+// job_server.cpp - Implements a server that keeps the device open and runs jobs that clients
+//                  queue over a unix-domain socket, one after another
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "job_server.h"
+using namespace std;
+using namespace std::chrono;
+
+// A client that sends a line longer than this without a newline is disconnected
+static const size_t MAX_LINE = 4096;
+
+// While waiting for work, we look for a shutdown request this often
+static const milliseconds SHUTDOWN_POLL(100);
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start() - Creates the socket and starts the thread that serves clients
+//=================================================================================================
+void JobServer::start(string path)
+{
+    sockaddr_un addr = {};
+
+    // If we're already serving, stop
+    stop();
+
+    if (path.size() >= sizeof(addr.sun_path)) throwRuntime("Socket name %s is too long", path.c_str());
+
+    // Create the socket, replacing any stale one left by a previous run
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) throwRuntime("Failed while creating socket %s", path.c_str());
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(listen_fd_, (sockaddr*)&addr, sizeof addr) < 0 || listen(listen_fd_, 8) < 0)
+    {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        throwRuntime("Can't listen on %s: %s", path.c_str(), strerror(errno));
+    }
+
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (stop_fd_ < 0) throwRuntime("Can't create an eventfd: %s", strerror(errno));
+
+    // Jobs that don't say otherwise run the way the feeder is configured now
+    path_           = path;
+    default_dir_    = feeder_.config.dir;
+    default_repeat_ = feeder_.config.max_repeats;
+    shutdown_       = false;
+
+    thread_ = std::thread(&JobServer::client_thread, this);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop() - Stops the client thread, disconnects every client and removes the socket
+//=================================================================================================
+void JobServer::stop()
+{
+    // If we're not serving, there's nothing to do
+    if (listen_fd_ < 0) return;
+
+    // Wake the thread and wait for it to quit
+    uint64_t one = 1;
+    if (write(stop_fd_, &one, sizeof one) < 0) perror("JobServer::stop");
+    if (thread_.joinable()) thread_.join();
+
+    for (auto& entry : clients_) ::close(entry.second.fd);
+    clients_.clear();
+
+    ::close(listen_fd_);
+    ::close(stop_fd_);
+    listen_fd_ = stop_fd_ = -1;
+    unlink(path_.c_str());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// run() - Runs queued jobs, each as soon as its start time arrives, until we're asked to stop
+//=================================================================================================
+void JobServer::run()
+{
+    while (true)
+    {
+        job_t job;
+
+        // Wait for a job to be due.  A job that's scheduled for later doesn't hold up the ones
+        // queued behind it: the job with the earliest start time runs first, and of those that
+        // share a start time, the one that was queued first
+        {
+            auto earlier = [](const job_t& a, const job_t& b) {return a.start_time < b.start_time;};
+            unique_lock<mutex> lock(mutex_);
+            deque<job_t>::iterator next;
+            while (true)
+            {
+                if (shutdown_) return;
+                auto wait = SHUTDOWN_POLL;
+                if (!queue_.empty())
+                {
+                    auto now = steady_clock::now();
+                    next = min_element(queue_.begin(), queue_.end(), earlier);
+                    if (next->start_time <= now) break;
+                    wait = min(wait, duration_cast<milliseconds>(next->start_time - now) + 1ms);
+                }
+                wakeup_.wait_for(lock, wait);
+            }
+            job = *next;
+            queue_.erase(next);
+            running_ = job.id;
+
+            // An abort meant for the previous job can arrive after it ended, but before
+            // running_ was cleared.  Throwing it away here, under the same lock the abort command
+            // takes, means only aborts sent while this job is running can stop it
+            feeder_.clear_abort_request();
+        }
+
+        run_job(job);
+
+        lock_guard<mutex> lock(mutex_);
+        running_ = 0;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// run_job() - Loads a job's dataset (from memory if it's there), sends it, and tells the client
+//             how long each part took.  "Setup" is everything from picking up the job to the
+//             start of the first bright-cycle
+//=================================================================================================
+void JobServer::run_job(const job_t& job)
+{
+    feeder_config_t& c = feeder_.config;
+    steady_clock::time_point first_bc;
+
+    c.dir         = job.dir.empty() ? default_dir_ : job.dir;
+    c.max_repeats = job.repeat ? job.repeat : default_repeat_;
+
+    // Note when the first bright-cycle starts
+    feeder_.on_bright_cycle([&](const bce_bc_info_t& info)
+    {
+        if (info.bc_count == 0) first_bc = steady_clock::now();
+    });
+
+    auto start_time = steady_clock::now();
+    try
+    {
+        feeder_.load_dataset();
+        auto loaded_time = steady_clock::now();
+
+        bool completed = feeder_.run();
+        auto end_time  = steady_clock::now();
+
+        bce_stats_t stats = feeder_.stats();
+        double load_ms  = duration<double, milli>(loaded_time - start_time).count();
+        double setup_ms = duration<double, milli>(first_bc - start_time).count();
+        double run_ms   = duration<double, milli>(end_time - start_time).count();
+        if (stats.bright_cycles == 0) setup_ms = run_ms;
+
+        char report[300];
+        sprintf
+        (
+            report, "%s bright_cycles=%lu dataset=%s load_ms=%.3f setup_ms=%.3f total_ms=%.3f",
+            completed ? "completed" : "aborted", stats.bright_cycles,
+            feeder_.dataset_cached() ? "cached" : "read", load_ms, setup_ms, run_ms
+        );
+        printf("Job %u (%s): %s\n", job.id, c.dir.c_str(), report);
+        reply(job.client, "done %u %s", job.id, report);
+    }
+    catch(const job_aborted&)
+    {
+        printf("Job %u (%s): aborted while loading\n", job.id, c.dir.c_str());
+        reply(job.client, "done %u aborted bright_cycles=0", job.id);
+    }
+    catch(const exception& e)
+    {
+        printf("Job %u (%s): failed: %s\n", job.id, c.dir.c_str(), e.what());
+        reply(job.client, "failed %u %s", job.id, e.what());
+    }
+
+    feeder_.on_bright_cycle(nullptr);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// client_thread() - Accepts clients and carries out the commands they send
+//=================================================================================================
+void JobServer::client_thread()
+{
+    while (true)
+    {
+        vector<pollfd>   fds = {{stop_fd_, POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+        vector<uint32_t> ids;
+
+        // Build the list of sockets to wait on
+        {
+            lock_guard<mutex> lock(clients_mutex_);
+            for (auto& entry : clients_)
+            {
+                fds.push_back({entry.second.fd, POLLIN, 0});
+                ids.push_back(entry.first);
+            }
+        }
+
+        int count = poll(fds.data(), fds.size(), -1);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0 || (fds[0].revents & POLLIN)) return;
+
+        // A new client
+        if (fds[1].revents & POLLIN)
+        {
+            int sd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (sd >= 0)
+            {
+                lock_guard<mutex> lock(clients_mutex_);
+                clients_[next_client_id_++] = {sd, ""};
+            }
+        }
+
+        // Commands from the clients we already have
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            if (fds[i + 2].revents == 0) continue;
+            if (read_client(ids[i])) continue;
+
+            // The client has gone.  Its jobs still run, but nobody hears how they went
+            lock_guard<mutex> lock(clients_mutex_);
+            ::close(clients_[ids[i]].fd);
+            clients_.erase(ids[i]);
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_client() - Reads what a client has sent and carries out every complete command in it
+//
+// Returns: false if the client has disconnected (or misbehaved)
+//=================================================================================================
+bool JobServer::read_client(uint32_t id)
+{
+    char   buffer[1024];
+
+    // Only this thread adds or removes clients, so the entry can't vanish while we use it
+    client_t& entry = clients_[id];
+
+    ssize_t length = recv(entry.fd, buffer, sizeof buffer, MSG_DONTWAIT);
+    if (length < 0 && (errno == EINTR || errno == EAGAIN)) return true;
+    if (length <= 0) return false;
+    entry.input.append(buffer, length);
+
+    // Carry out every complete line, and keep whatever is left for next time
+    size_t start = 0, end;
+    while ((end = entry.input.find('\n', start)) != string::npos)
+    {
+        string line = entry.input.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) execute(id, line);
+        start = end + 1;
+    }
+    entry.input.erase(0, start);
+    return entry.input.size() <= MAX_LINE;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// execute() - Carries out one command from a client
+//=================================================================================================
+void JobServer::execute(uint32_t client, const string& line)
+{
+    istringstream stream(line);
+    string command, args;
+    stream >> command;
+    getline(stream, args);
+
+    if (command == "run")
+    {
+        queue_job(client, args);
+        return;
+    }
+
+    if (command == "status")
+    {
+        lock_guard<mutex> lock(mutex_);
+        string ids;
+        for (auto& job : queue_) ids += " " + to_string(job.id);
+        if (running_)
+            reply(client, "running %u queued %zu%s", running_, queue_.size(), ids.c_str());
+        else
+            reply(client, "idle queued %zu%s", queue_.size(), ids.c_str());
+        return;
+    }
+
+    if (command == "cancel")
+    {
+        uint32_t id = strtoul(args.c_str(), nullptr, 0);
+        lock_guard<mutex> lock(mutex_);
+        for (auto it = queue_.begin(); it != queue_.end(); ++it)
+        {
+            if (it->id != id) continue;
+            if (it->client != client) reply(it->client, "cancelled %u", id);
+            queue_.erase(it);
+            reply(client, "cancelled %u", id);
+            return;
+        }
+        reply(client, "error job %u isn't queued", id);
+        return;
+    }
+
+    if (command == "abort")
+    {
+        // An abort request is only consumed by a running job, so don't leave one lying around
+        lock_guard<mutex> lock(mutex_);
+        if (running_ == 0)
+        {
+            reply(client, "error no job is running");
+            return;
+        }
+        feeder_.request_abort("job server");
+        reply(client, "aborting %u", running_);
+        return;
+    }
+
+    if (command == "shutdown")
+    {
+        lock_guard<mutex> lock(mutex_);
+        shutdown_ = true;
+        wakeup_.notify_all();
+        reply(client, "ok");
+        return;
+    }
+
+    reply(client, "error unknown command '%s'", command.c_str());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// queue_job() - Parses the arguments of a "run" command and adds the job to the queue
+//=================================================================================================
+void JobServer::queue_job(uint32_t client, const string& args)
+{
+    istringstream stream(args);
+    string arg;
+    job_t  job = {0, "", 0, steady_clock::now(), client};
+
+    while (stream >> arg)
+    {
+        auto equals = arg.find('=');
+        string name  = arg.substr(0, equals);
+        string value = (equals == string::npos) ? "" : arg.substr(equals + 1);
+
+        if (name == "dir" && !value.empty())
+        {
+            job.dir = value;
+            continue;
+        }
+
+        if (name == "repeat" && atoi(value.c_str()) > 0)
+        {
+            job.repeat = atoi(value.c_str());
+            continue;
+        }
+
+        // A start time is either relative (in ms) or a unix time (in seconds)
+        if (name == "at" && !value.empty())
+        {
+            if (value[0] == '+')
+                job.start_time += milliseconds(atol(value.c_str() + 1));
+            else
+            {
+                auto when = duration<double>(atof(value.c_str()))
+                          - system_clock::now().time_since_epoch();
+                job.start_time += duration_cast<steady_clock::duration>(when);
+            }
+            continue;
+        }
+
+        reply(client, "error invalid argument '%s'", arg.c_str());
+        return;
+    }
+
+    lock_guard<mutex> lock(mutex_);
+    if (shutdown_)
+    {
+        reply(client, "error shutting down");
+        return;
+    }
+
+    job.id = next_job_id_++;
+    queue_.push_back(job);
+    wakeup_.notify_all();
+    reply(client, "queued %u", job.id);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// reply() - Sends one line of text to a client.  A client that has disconnected, or that isn't
+//           reading its replies, misses the line
+//=================================================================================================
+void JobServer::reply(uint32_t client, const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int length = vsnprintf(buffer, sizeof buffer - 1, fmt, ap);
+    va_end(ap);
+    if (length > (int)sizeof buffer - 2) length = sizeof buffer - 2;
+    buffer[length++] = '\n';
+
+    lock_guard<mutex> lock(clients_mutex_);
+    auto it = clients_.find(client);
+    if (it == clients_.end()) return;
+    send(it->second.fd, buffer, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+//=================================================================================================
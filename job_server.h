@@ -0,0 +1,120 @@
+//=================================================================================================
+// job_server.h - Defines a server that keeps the device open and runs jobs that clients queue
+//                over a unix-domain socket, one after another
+//
+// Clients send commands as lines of text:
+//
+//      run [dir=<dir>] [repeat=<count>] [at=<time>]   Queues a job.  "at" is either a unix time
+//                                                     in seconds or "+<ms>" from now, and the
+//                                                     job won't start before then
+//      status                                         Describes the running job and the queue
+//      cancel <id>                                    Removes a job from the queue
+//      abort                                          Aborts the running job
+//      shutdown                                       Stops once the running job is finished
+//
+// Every command gets a one-line reply.  "run" is answered with "queued <id>", and once the job
+// is over the same connection is sent "done <id> ..." or "failed <id> <reason>"
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "feeder.h"
+
+class JobServer
+{
+public:
+
+    // Constructor and destructor
+    JobServer(Feeder& feeder) : feeder_(feeder) {}
+    ~JobServer() {stop();}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    JobServer(const JobServer&) = delete;
+    JobServer& operator= (const JobServer&) = delete;
+
+    // Starts accepting clients on a unix-domain socket at "path".  Jobs that don't name a
+    // directory or repeat count use whatever the feeder is configured with now
+    void    start(std::string path);
+
+    // Stops accepting clients and removes the socket
+    void    stop();
+
+    // Runs queued jobs until a client asks us to shut down (or request_shutdown() is called).
+    // The device must already be open
+    void    run();
+
+    // Asks run() to return once the running job is finished.  Safe to call from a signal
+    // handler
+    void    request_shutdown() {shutdown_ = true;}
+
+protected:
+
+    // A job waiting to be run
+    struct job_t
+    {
+        uint32_t    id;
+        std::string dir;
+        int         repeat;
+        std::chrono::steady_clock::time_point start_time;
+        uint32_t    client;
+    };
+
+    // A connected client and the part of a command line we've received from it
+    struct client_t
+    {
+        int         fd;
+        std::string input;
+    };
+
+    // The background thread that accepts clients and carries out their commands
+    void    client_thread();
+
+    // Reads whatever a client has sent.  Returns false when the client has gone away
+    bool    read_client(uint32_t id);
+
+    // Carries out one command from a client
+    void    execute(uint32_t client, const std::string& line);
+    void    queue_job(uint32_t client, const std::string& args);
+
+    // Runs a single job and tells the client how it went
+    void    run_job(const job_t& job);
+
+    // Sends a line of text to a client, if it's still connected
+    void    reply(uint32_t client, const char* fmt, ...);
+
+    // The feeder that runs every job
+    Feeder&     feeder_;
+
+    // What a job uses when it doesn't say
+    std::string default_dir_;
+    int         default_repeat_ = 1;
+
+    // The queue, the job that's running (0 = none), and the next job ID
+    std::deque<job_t>       queue_;
+    uint32_t                running_ = 0;
+    uint32_t                next_job_id_ = 1;
+    std::mutex              mutex_;
+    std::condition_variable wakeup_;
+
+    // The connected clients, keyed by an ID that's never re-used.  Only the client thread adds
+    // and removes them, under clients_mutex_.  When both mutexes are held, mutex_ comes first
+    std::map<uint32_t, client_t> clients_;
+    uint32_t                next_client_id_ = 1;
+    std::mutex              clients_mutex_;
+
+    // This is set when it's time to stop running jobs
+    std::atomic<bool>       shutdown_{false};
+
+    // The listening socket, its filename, the eventfd that stops the thread, and the thread
+    int                     listen_fd_ = -1;
+    int                     stop_fd_ = -1;
+    std::string             path_;
+    std::thread             thread_;
+};
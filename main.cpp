@@ -5,74 +5,59 @@
 #include <string>
 #include <cstdarg>
 #include <vector>
-#include <filesystem>
-#include <algorithm>
 #include <chrono>
 #include <cstring>
+#include <map>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <signal.h>
+#include <sys/wait.h>
 #include "history.h"
-#include "config_file.h"
-#include "PciDevice.h"
+#include "feeder.h"
+#include "reg_trace.h"
+#include "shm_source.h"
+#include "job_server.h"
 
 using namespace std;
-namespace fs = std::filesystem;
-typedef vector<uint32_t> intvec_t;
-
-const uint32_t BC_EMU_RTL_ID = 912018;
 
 struct global_t
 {
     string   config_file = "bce_feeder.conf";
-    string   pci_device;
     string   dir;
+    string   patch_file;
+    string   frame_pack;
+    string   make_pack_file;
     int      max_repeats = 1;
     bool     verbose = false;
     bool     help = false;
-    uint32_t bc_count;
-    
-    // Offsets to the BC_EMU registers
-    uint32_t reg_fifo0_offset;
-    uint32_t reg_fifo1_offset;
-    uint32_t reg_fifo_ctl_offset;
-    uint32_t reg_fifo_select_offset;
-    uint32_t reg_cont_mode_offset;
-    uint32_t reg_abort_offset;
-    uint32_t reg_bc_count_offset;
-    uint32_t reg_rtl_major_offset = 0x00;
-    uint32_t reg_rtl_minor_offset = 0x04;
-    uint32_t reg_rtl_id_offset    = 0x14;
-
-    // Pointers (in userspace) to the BC_EMU registers
-    volatile uint32_t* reg_rtl_id;
-    volatile uint32_t* reg_fifo0;
-    volatile uint32_t* reg_fifo1;
-    volatile uint32_t* reg_fifo_ctl;
-    volatile uint32_t* reg_fifo_select;
-    volatile uint32_t* reg_cont_mode;
-    volatile uint32_t* reg_abort;
-    volatile uint32_t* reg_bc_count;
-    volatile uint32_t* reg_rtl_major;
-    volatile uint32_t* reg_rtl_minor;
-
-    // This is a list of data-files to use for frame-data
-    vector<string> data_files;
-
-    // This is a vector of "vectors of 32-bit intgers".  Each integer
-    // vector represents the frame data for a single bright-cycle
-    vector<intvec_t> frame_data;
-
+    string   reg_trace_file;
+    string   replay_file;
+    string   compare_file;
+    bool     predict = false;
+    bool     calibrate = false;
+    string   write_manifest_file;
+    string   frame_socket;
+    string   shm_ring;
+    uint32_t shm_bench_frames = 0;
+    bool     watch = false;
+    string   serve_socket;
+    string   trace_file;
+    double   cadence_hz = 0;
 } g;
 
-// This provides memory read/write access to the PCI device we care about
-PciDevice device;
+// This is the engine that does all of the real work
+Feeder feeder;
+
+// In server mode, this runs the jobs that clients queue
+JobServer* job_server = nullptr;
 
 // Forward declarations
 void execute(int argc, const char** argv);
-void read_frame_data_files();
-vector<string> get_file_list_from_directory(std::string directory);
-bool start_fifo(uint32_t which);
 int create_udp_server(int port);
+void replay_register_trace();
+void run_shm_benchmark();
+void serve_jobs();
+void show_cadence_report();
 
 //=============================================================================
 // This routine isn't really a part of the program.  It exists to provide
@@ -118,6 +103,7 @@ int main(int argc, const char** argv)
 
 
 
+
 //=============================================================================
 // throwRuntime() - Throws a runtime exception
 //=============================================================================
@@ -134,6 +120,35 @@ static void throwRuntime(const char* fmt, ...)
 //=============================================================================
 
 
+//=============================================================================
+// on_abort_signal() - Handles SIGINT and SIGTERM by requesting an abort.  
+//                     The handler is one-shot, so a second signal will kill
+//                     the program outright
+//=============================================================================
+static void on_abort_signal(int signum)
+{
+    feeder.request_abort(signum == SIGINT ? "SIGINT" : "SIGTERM");
+    if (job_server) job_server->request_shutdown();
+}
+//=============================================================================
+
+
+//=============================================================================
+// install_signal_handlers() - Arranges for SIGINT and SIGTERM to abort the job
+//=============================================================================
+static void install_signal_handlers()
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_abort_signal;
+    sa.sa_flags   = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT,  &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+}
+//=============================================================================
+
+
 //=============================================================================
 // parse_command_line() - Parse the command line options and fill in the 
 //                        corresponding global variables
@@ -162,12 +177,108 @@ void parse_command_line(const char** argv)
             continue;
         }
 
+        if (token == "-patch" && argv[i])
+        {
+            g.patch_file = argv[i++];
+            continue;
+        }
+
+        if (token == "-pack" && argv[i])
+        {
+            g.frame_pack = argv[i++];
+            continue;
+        }
+
+        if (token == "-makepack" && argv[i])
+        {
+            g.make_pack_file = argv[i++];
+            continue;
+        }
+
         if (token == "-repeat" && argv[i])
         {
             g.max_repeats = atoi(argv[i++]);
             continue;
         }
 
+        if (token == "-regtrace" && argv[i])
+        {
+            g.reg_trace_file = argv[i++];
+            continue;
+        }
+
+        if (token == "-trace" && argv[i])
+        {
+            g.trace_file = argv[i++];
+            continue;
+        }
+
+        if (token == "-replay" && argv[i])
+        {
+            g.replay_file = argv[i++];
+            continue;
+        }
+
+        if (token == "-compare" && argv[i])
+        {
+            g.compare_file = argv[i++];
+            continue;
+        }
+
+        if (token == "-predict")
+        {
+            g.predict = true;
+            continue;
+        }
+
+        if (token == "-calibrate")
+        {
+            g.calibrate = true;
+            continue;
+        }
+
+        if (token == "-manifest" && argv[i])
+        {
+            g.write_manifest_file = argv[i++];
+            continue;
+        }
+
+        if (token == "-listen" && argv[i])
+        {
+            g.frame_socket = argv[i++];
+            continue;
+        }
+
+        if (token == "-shm" && argv[i])
+        {
+            g.shm_ring = argv[i++];
+            continue;
+        }
+
+        if (token == "-shmbench" && argv[i])
+        {
+            g.shm_bench_frames = strtoul(argv[i++], 0, 0);
+            continue;
+        }
+
+        if (token == "-cadence" && argv[i])
+        {
+            g.cadence_hz = atof(argv[i++]);
+            continue;
+        }
+
+        if (token == "-watch")
+        {
+            g.watch = true;
+            continue;
+        }
+
+        if (token == "-serve" && argv[i])
+        {
+            g.serve_socket = argv[i++];
+            continue;
+        }
+
         if (token == "-verbose")
         {
             g.verbose = true;
@@ -190,46 +301,6 @@ void parse_command_line(const char** argv)
 //=============================================================================
 
 
-//=============================================================================
-// parse the configuration file
-//=============================================================================
-void parse_config_file(const string filename)
-{
-    CConfigFile cf;
-    CConfigScript s;
-    
-    // Read the configuration file
-    if (!cf.read(filename)) exit(1);
-
-    // Fetch the VendorID:DeviceID of the PCI device we're interested in
-    cf.get("pci_device", &g.pci_device);
-
-    // Fetch the offsets of the registers we care about
-    cf.get("reg_fifo0",       &g.reg_fifo0_offset      );
-    cf.get("reg_fifo1",       &g.reg_fifo1_offset      );
-    cf.get("reg_fifo_ctl",    &g.reg_fifo_ctl_offset   );
-    cf.get("reg_fifo_select", &g.reg_fifo_select_offset);
-    cf.get("reg_cont_mode",   &g.reg_cont_mode_offset  );
-    cf.get("reg_abort",       &g.reg_abort_offset      );
-    cf.get("reg_bc_count",    &g.reg_bc_count_offset   );
-
-    // If "data_files" exists in the configuration file, fetch a list 
-    // of data-files to use as frame-data
-    if (cf.exists("data_files"))
-    {
-        cf.get("data_files", &s);
-        while (s.get_next_line())
-        {
-            auto filename = s.get_next_token();
-            g.data_files.push_back(filename);
-        }
-    }
-
-}
-//=============================================================================
-
-
-
 //=============================================================================
 // This just displays help text and exits
 //=============================================================================
@@ -243,7 +314,23 @@ void show_help()
         "Valid switches\n"
         "  -config <filename> = Specify configuration file\n"
         "  -dir <dir_name>    = Specify directory for data_files\n"
+        "  -patch <file>      = Read the dataset from a file of base frames and patches\n"
+        "  -pack <file>       = Send the frames in a frame pack\n"
+        "  -makepack <file>   = Build a frame pack from the -dir or data_files dataset\n"
         "  -repeat <count>    = Specify number of times to send each bright-cycle\n"
+        "  -regtrace <file>   = Record every register access into <file>\n"
+        "  -trace <file>      = Write a timeline of the run into <file> (Perfetto)\n"
+        "  -replay <file>     = Analyze a register trace instead of running a job\n"
+        "  -compare <file>    = With -replay, compare against a second trace\n"
+        "  -predict           = Predict load times and slack without touching the card\n"
+        "  -calibrate         = Find the fastest safe FIFO load rate for this card\n"
+        "  -manifest <file>   = Write the CRC32C of every data-file into <file>\n"
+        "  -listen <socket>   = Send frames received on a unix-domain socket\n"
+        "  -shm <name>        = Send frames written into a shared-memory ring\n"
+        "  -shmbench <count>  = Measure shared-memory ring throughput\n"
+        "  -cadence <hz>      = Start bright-cycles at exactly <hz> per second\n"
+        "  -watch             = Re-read files in the -dir directory as they change\n"
+        "  -serve <socket>    = Keep the card open and run jobs queued on <socket>\n"
         "  -verbose           = Show debugging messages\n"
         "  -help              = Show this help text\n"
     );
@@ -259,6 +346,8 @@ void show_help()
 //=============================================================================
 void execute(int argc, const char** argv)
 {
+    bool completed;
+
     // Parse the command line options
     parse_command_line(argv);
 
@@ -270,405 +359,496 @@ void execute(int argc, const char** argv)
         printf("bce_feeder v%s\n",SW_VERSION);        
     }
 
-    // If we can't create this UDP server, bc_feeder is already running
-    if (create_udp_server(32725) < 0)
+    // Parse the configuration file
+    auto config_time = chrono::steady_clock::now();
+    feeder.read_config(g.config_file);
+    feeder.note_startup_phase("read config", config_time);
+
+    // The command line overrides the configuration file
+    if (!g.dir.empty()) feeder.config.dir = g.dir;
+    if (!g.patch_file.empty()) feeder.config.patch_file = g.patch_file;
+    if (!g.frame_pack.empty()) feeder.config.frame_pack = g.frame_pack;
+    feeder.config.max_repeats    = g.max_repeats;
+    feeder.config.verbose        = g.verbose;
+    feeder.config.reg_trace_file = g.reg_trace_file;
+    if (!g.trace_file.empty()) feeder.config.trace_file = g.trace_file;
+    if (!g.frame_socket.empty()) feeder.config.frame_socket = g.frame_socket;
+    if (!g.shm_ring.empty()) feeder.config.shm_ring = g.shm_ring;
+    if (g.watch) feeder.config.watch = true;
+    if (g.cadence_hz > 0) feeder.config.cadence_hz = g.cadence_hz;
+
+    // If we're analyzing a register trace, that's all we're doing
+    if (!g.replay_file.empty())
     {
-        throwRuntime("bce_feeder is already running");
+        replay_register_trace();
+        return;
     }
 
-    // Parse the configuration file
-    parse_config_file(g.config_file);
-
-    // Map the PCI-device's memory into userspace
-    device.open(g.pci_device);
-
-    // Fetch the userspace pointer to the device's first resource
-    auto base_ptr = device.resourceList()[0].baseAddr;
-
-    // Compute the addresses of the pointers to the BC_EMU registers
-    g.reg_rtl_id      = (uint32_t*)(base_ptr + g.reg_rtl_id_offset);
-    g.reg_fifo0       = (uint32_t*)(base_ptr + g.reg_fifo0_offset);
-    g.reg_fifo1       = (uint32_t*)(base_ptr + g.reg_fifo1_offset);
-    g.reg_fifo_ctl    = (uint32_t*)(base_ptr + g.reg_fifo_ctl_offset);
-    g.reg_fifo_select = (uint32_t*)(base_ptr + g.reg_fifo_select_offset);
-    g.reg_cont_mode   = (uint32_t*)(base_ptr + g.reg_cont_mode_offset);
-    g.reg_abort       = (uint32_t*)(base_ptr + g.reg_abort_offset);
-    g.reg_bc_count    = (uint32_t*)(base_ptr + g.reg_bc_count_offset);
-    g.reg_rtl_major   = (uint32_t*)(base_ptr + g.reg_rtl_major_offset);
-    g.reg_rtl_minor   = (uint32_t*)(base_ptr + g.reg_rtl_minor_offset);
-
-    // Check to make sure that BC_EMU is actually loaded!
-    if (*g.reg_rtl_id != BC_EMU_RTL_ID) throwRuntime("BC_EMU isn't loaded!");
-
-    // Determine the major/minor version of the RTL build
-    uint32_t rtl_version = (*g.reg_rtl_major << 16) | *g.reg_rtl_minor;
-
-    // If we don't have the correct version of the BC_EMU RTL, complain
-    if (rtl_version < 0x10018) throwRuntime("BC_EMU version 1.24 or greater required");
+    // If we're writing a CRC manifest, that's all we're doing
+    if (!g.write_manifest_file.empty())
+    {
+        feeder.load_dataset();
+        feeder.write_crc_manifest(g.write_manifest_file);
+        return;
+    }
 
-    // If this becomes non-zero, we abort
-    *g.reg_abort = 0;
+    // If we're building a frame pack, that's all we're doing
+    if (!g.make_pack_file.empty())
+    {
+        size_t count = feeder.write_frame_pack(g.make_pack_file);
+        printf("Packed %lu frames into %s\n", count, g.make_pack_file.c_str());
+        return;
+    }
 
-    // So far, we've completed no bright-cycles
-    g.bc_count = 0;
-    *g.reg_bc_count = g.bc_count;
+    // If we're benchmarking the shared-memory ring, that's all we're doing
+    if (g.shm_bench_frames)
+    {
+        run_shm_benchmark();
+        return;
+    }
 
-    // Ensure that the RTL is not alreay sending packets
-    // from some previous instantiation
-    *g.reg_fifo_select = 0;
-    while (*g.reg_fifo_select) usleep(1000);
+    // If we're predicting throughput, that's all we're doing
+    if (g.predict)
+    {
+        feeder.load_dataset();
+        feeder.predict();
+        return;
+    }
 
-    // If the user gave us a directory name, fetch the filenames from it
-    if (!g.dir.empty())
+    // If we can't create this UDP server, bc_feeder is already running
+    auto lock_time = chrono::steady_clock::now();
+    int udp_socket = create_udp_server(32725);
+    feeder.note_startup_phase("instance lock", lock_time);
+    if (udp_socket < 0)
     {
-        auto v = get_file_list_from_directory(g.dir);
-        g.data_files = v;
+        throwRuntime("bce_feeder is already running");
     }
 
-    // If the user hasn't specified any data files, complain
-    if (g.data_files.empty()) throwRuntime("No data-files specified");
+    // The UDP socket doubles as our control channel
+    feeder.set_control_socket(udp_socket);
 
-    // Read and parse the frame-data files into g.frame_data
-    read_frame_data_files();
+    // From here on, SIGINT and SIGTERM stop the job cleanly
+    install_signal_handlers();
 
-    // Reset the BC_EMU FIFOs
-    *g.reg_fifo_ctl = 3;
-    while (true)
+    // In server mode, we run jobs until a client (or a signal) tells us to stop
+    if (!g.serve_socket.empty())
     {
-        usleep(1000);
-        if (*g.reg_fifo_ctl == 0) break;
+        serve_jobs();
+        feeder.close();
+        return;
     }
 
-    // Place BC_EMU into continuous mode
-    *g.reg_cont_mode = 1;
-
-
-    // Sending bright-cycles to alternating FIFOs
-    uint32_t which_fifo = 0;
-    while (start_fifo(which_fifo))
+    try
     {
-        *g.reg_bc_count = g.bc_count++;
-        if (0) for (int i=0; i<10; ++i)
+        // Read and parse the frame-data files, or get ready to receive frames
+        auto prepare_frames = []()
         {
-            printf("%u\n", *g.reg_bc_count);
-        }
-        which_fifo = 1 - which_fifo;
+            if (g.calibrate)
+                feeder.load_dataset();
+            else if (!feeder.config.shm_ring.empty())
+                feeder.create_ring(feeder.config.shm_ring);
+            else if (!feeder.config.frame_socket.empty())
+                feeder.listen(feeder.config.frame_socket);
+            else
+                feeder.load_dataset();
+        };
+
+        // Do that while we map the device and make sure BC_EMU is ready for
+        // us.  When calibrating, we start from the configured pacing
+        feeder.start_up(prepare_frames, !g.calibrate);
+
+        // And send them (or use them to calibrate the card)
+        completed = g.calibrate ? feeder.calibrate() : feeder.run();
+
+        // If the job was aborted, report how long it took to honor the request
+        if (!completed) printf
+        (
+            "Job aborted by %s: noticed within %li us, device stopped within %li us\n",
+            feeder.abort_source(), feeder.abort_noticed_us(), feeder.abort_stopped_us()
+        );
+
+        // Show how closely the job kept to its cadence
+        if (!g.calibrate && feeder.config.cadence_hz) show_cadence_report();
+    }
+    catch(const job_aborted&)
+    {
+        printf("Job aborted by %s before the first bright-cycle\n", feeder.abort_source());
     }
 
-    // Tell the bright-cycle count register how many bright-cycles 
-    // were completed
-    *g.reg_bc_count = g.bc_count;
-   
+    // If we were recording register accesses, flush the trace to disk
+    feeder.close();
+    if (feeder.trace_dropped())
+    {
+        fprintf(stderr, "Register trace dropped %lu records\n", feeder.trace_dropped());
+    }
+    if (feeder.spans_dropped())
+    {
+        fprintf(stderr, "Timeline dropped %lu spans\n", feeder.spans_dropped());
+    }
 }
 //=============================================================================
 
 
 
-
-//=============================================================================
-// is_ws() - Returns true if the character pointed to is a space or tab
-//=============================================================================
-static bool is_ws(const char* p) {return ((*p == 32) || (*p == 9));}
-//=============================================================================
-
-
 //=============================================================================
-// is_eol() - Returns true if the character pointed to is an end-of-line chr
+// create_udp_server() - Returns the file-descriptor of an open UDP server socket
 //=============================================================================
-static bool is_eol(const char* p)
+int create_udp_server(int port)
 {
-    return ((*p == 10) || (*p == 13) || (*p == 0));
-}
-//=============================================================================
+    // Create the socket and complain if we can't
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sd < 0)
+    {
+        throwRuntime("Failed while creating UDP socket");
+    }
 
+    // Build the address structure of the UDP server
+    struct sockaddr_in serveraddr;
+    memset(&serveraddr, 0, sizeof(serveraddr));
+    serveraddr.sin_family = AF_INET;
+    serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serveraddr.sin_port = htons((unsigned short)port);
 
-//=============================================================================
-// skip_comma() - On return, the return value points to either an end-of-line 
-//                character, or to the character immediately after a comma
-//=============================================================================
-static const char* skip_comma(const char* p)
-{
-    while (true)
+    // Bind the socket to the port
+    if (bind(sd, (struct sockaddr *) &serveraddr, sizeof(serveraddr)) < 0)
     {
-        if (*p == ',') return p+1;
-        if (is_eol(p)) return p;
-        ++p;
+        return -1;
     }
+
+    // Return the socket descriptor to the caller
+    return sd;
 }
 //=============================================================================
 
 
 
 //=============================================================================
-// readMtVector() - Reads a CSV file full of integers and returns a vector
-//                  containing them.  Values in file can be in hex or decimal,
-//                  and can be comma separated into lines of arbitrary length. 
-//                  File can contain blank lines and comment lines beginning
-//                  with either "#" or "//"
-//
-// Will throw std::runtime error if file doesn't exist
+// This describes the FIFO load that preceded one hand-off to fifo_select
 //=============================================================================
-intvec_t read_mt_vector(std::string filename)
+struct handoff_t
 {
-    char buffer[0x10000];
-    intvec_t result;
-
-    // In verbose mode, tell the user what we're doing
-    if (g.verbose) printf("Reading %s\n", filename.c_str());
+    uint32_t words;         // Number of words written to the FIFO
+    double   load_us;       // From the first FIFO write to the hand-off
+    double   active_us;     // From the hand-off until the RTL reported it
+};
+//=============================================================================
 
-    // Try to open the input file
-    FILE* ifile = fopen(filename.c_str(), "r");
 
-    // Complain if we can't
-    if (ifile == NULL) throwRuntime("can't read %s", filename.c_str());
+//=============================================================================
+// analyze_handoffs() - Finds every write of a FIFO bit to fifo_select in a
+//                      trace and describes the FIFO load that preceded it
+//=============================================================================
+static vector<handoff_t> analyze_handoffs
+(
+    const reg_trace_header_t& header, 
+    const vector<reg_trace_rec_t>& records
+)
+{
+    vector<handoff_t> result;
+    uint32_t words = 0;
+    uint64_t first_write_tsc = 0;
+    double   us_per_tick = 1e6 / header.tsc_hz;
 
-    // Loop through each line of the file
-    while (fgets(buffer, sizeof buffer, ifile))
+    for (size_t i=0; i<records.size(); ++i)
     {
-        // Point to the first byte of the buffer
-        const char* p = buffer;
-
-        // Skip over any leading whitespace
-        while (is_ws(p)) ++p;
-
-        // If the line is a "//" comment, skip it
-        if (p[0] == '/' && p[1] == '/') continue;
-
-        // If the line is a '#' comment, skip it
-        if (*p == '#') continue;
+        auto& rec      = records[i];
+        bool  is_write = rec.offset & REG_TRACE_WRITE;
+        auto  offset   = rec.offset & ~REG_TRACE_WRITE;
 
-        // This loop parses out comma-separated fields
-        while (true)
+        // Count the words written into either FIFO
+        if (is_write && (offset == feeder.config.registers[REG_FIFO0] || offset == feeder.config.registers[REG_FIFO1]))
         {
-            // Skip over leading whitespace
-            while (is_ws(p)) ++p;
+            if (words++ == 0) first_write_tsc = rec.tsc;
+            continue;
+        }
 
-            // If we've found the end of the line, we're done
-            if (is_eol(p)) break;
+        // We only care about FIFO hand-offs
+        if (!is_write || offset != feeder.config.registers[REG_FIFO_SELECT] || rec.value == 0) continue;
 
-            // Extract this value from the string
-            uint32_t value = strtoul(p, nullptr, 0);
+        handoff_t handoff = {words, 0, -1};
+        if (words) handoff.load_us = (rec.tsc - first_write_tsc) * us_per_tick;
 
-            // Append it to our result vector
-            result.push_back(value);
-        
-            // Point to the next field
-            p = skip_comma(p);
+        // Find where the RTL reported that this FIFO became active
+        for (size_t j=i+1; j<records.size(); ++j)
+        {
+            auto& later = records[j];
+            if (later.offset != feeder.config.registers[REG_FIFO_SELECT] || later.value != rec.value) continue;
+            handoff.active_us = (later.tsc - rec.tsc) * us_per_tick;
+            break;
         }
-    }
 
-    // Close the input file, we're done reading it
-    fclose(ifile);
+        result.push_back(handoff);
+        words = 0;
+    }
 
-    // Hand the resulting vector to the caller
     return result;
 }
 //=============================================================================
 
 
 //=============================================================================
-// This reads in all of the files specified by g.data_file.  Each file is
-// parsed into a vector of integers, and that vector is appended to the
-// structure g.frame_data
+// show_trace_summary() - Displays the timing and register usage of a trace
 //=============================================================================
-void read_frame_data_files()
+static void show_trace_summary
+(
+    const string& filename,
+    const reg_trace_header_t& header, 
+    const vector<reg_trace_rec_t>& records
+)
 {
-    for (auto filename : g.data_files)
+    map<uint32_t, pair<uint64_t, uint64_t>> usage;
+
+    // Count the reads and writes of every register
+    for (auto& rec : records)
     {
-        intvec_t v = read_mt_vector(filename);
-        g.frame_data.push_back(v);
+        auto& entry = usage[rec.offset & ~REG_TRACE_WRITE];
+        if (rec.offset & REG_TRACE_WRITE) ++entry.second; else ++entry.first;
     }
-}
-//=============================================================================
 
+    // Compute how long the trace lasted
+    double duration_ms = (records.back().tsc - records.front().tsc) * 1e3 / header.tsc_hz;
+
+    printf("%s: %lu accesses over %.3f ms\n", filename.c_str(), records.size(), duration_ms);
+    for (auto& entry : usage)
+    {
+        printf
+        (
+            "  %-12s %10lu reads %10lu writes\n", feeder.register_name(entry.first).c_str(), 
+            entry.second.first, entry.second.second
+        );
+    }
 
+    // Show the details of every FIFO hand-off
+    auto handoffs = analyze_handoffs(header, records);
+    for (size_t i=0; i<handoffs.size(); ++i)
+    {
+        auto& h = handoffs[i];
+        printf("  hand-off %4lu: %6u words, load %10.1f us, ", i, h.words, h.load_us);
+        if (h.active_us < 0) printf("never active\n");
+        else                 printf("active after %10.1f us\n", h.active_us);
+    }
+}
+//=============================================================================
 
 
 //=============================================================================
-// This returns a list containing the name of every .csv file in the specified
-// directory.   The returned list is sorted alphabetically
+// compare_traces() - Compares the register writes of two traces and reports
+//                    the first place they diverge and the difference in
+//                    FIFO load timing
 //=============================================================================
-vector<string> get_file_list_from_directory(std::string directory)
+static void compare_traces
+(
+    const reg_trace_header_t& header1, const vector<reg_trace_rec_t>& records1,
+    const reg_trace_header_t& header2, const vector<reg_trace_rec_t>& records2
+)
 {
-    vector<string> result;
-
-    for (const auto & entry : fs::directory_iterator(directory))
+    vector<const reg_trace_rec_t*> writes1, writes2;
+
+    // Extract the writes from each trace
+    for (auto& rec : records1) if (rec.offset & REG_TRACE_WRITE) writes1.push_back(&rec);
+    for (auto& rec : records2) if (rec.offset & REG_TRACE_WRITE) writes2.push_back(&rec);
+
+    // Find the first write that differs between them
+    size_t count = min(writes1.size(), writes2.size());
+    size_t index = 0;
+    while (index < count && writes1[index]->offset == writes2[index]->offset 
+                         && writes1[index]->value  == writes2[index]->value) ++index;
+
+    if (index == count && writes1.size() == writes2.size())
+        printf("Register writes are identical (%lu writes)\n", count);
+    else if (index == count)
+        printf("Register writes match for %lu writes, then one trace ends\n", count);
+    else
     {
-        // Get the extension of this directory entry
-        auto extent = entry.path().extension();
-
-        // If this is a .csv file, add it to the result list
-        if (fs::is_regular_file(entry.status()) && extent == ".csv")
-        {
-            result.push_back(entry.path());
-        }
+        auto offset = writes1[index]->offset & ~REG_TRACE_WRITE;
+        printf
+        (
+            "Register writes diverge at write %lu: %s=0x%08X vs %s=0x%08X\n", index,
+            feeder.register_name(offset).c_str(), writes1[index]->value,
+            feeder.register_name(writes2[index]->offset & ~REG_TRACE_WRITE).c_str(), writes2[index]->value
+        );
     }
 
-    // Sort the result list
-    std::sort(result.begin(), result.end());
-
-    // Hand the resulting, sorted list to the caller
-    return result;
+    // Compare the average FIFO load time of the two traces
+    auto handoffs1 = analyze_handoffs(header1, records1);
+    auto handoffs2 = analyze_handoffs(header2, records2);
+    double total1 = 0, total2 = 0;
+    for (auto& h : handoffs1) total1 += h.load_us;
+    for (auto& h : handoffs2) total2 += h.load_us;
+    if (!handoffs1.empty() && !handoffs2.empty())
+    {
+        double avg1 = total1 / handoffs1.size(), avg2 = total2 / handoffs2.size();
+        printf
+        (
+            "Average FIFO load: %.1f us vs %.1f us (%+.1f%%)\n", avg1, avg2, 
+            (avg2 - avg1) * 100 / avg1
+        );
+    }
 }
 //=============================================================================
 
 
 
 //=============================================================================
-// Returns the index (within g.frame_data) of the next vector of frame data
-// to load into a fifo.
+// replay_register_trace() - Re-drives a register trace against a memory-
+//                           backed stand-in for the BC_EMU register space,
+//                           then reports the timing of the original run
 //=============================================================================
-int get_next_frame_index()
+void replay_register_trace()
 {
-    static int current_frame_index = 0;
-    static int current_repeat = 0;
+    reg_trace_header_t      header;
+    vector<reg_trace_rec_t> records;
 
-    // If this is the first time we've been called...
-    if (current_repeat == 0)
-    {
-        current_repeat = 1;
-        return current_frame_index;
-    }
+    // Read the trace file
+    read_reg_trace(g.replay_file, header, records);
+    if (records.empty()) throwRuntime("%s contains no register accesses", g.replay_file.c_str());
 
-    // We are either going to repeat this frame, or we
-    // need to increment to a new frame
-    if (current_repeat < g.max_repeats)
-        ++current_repeat;
-    else
-    {
-        current_repeat = 1;
-        ++current_frame_index;
-    }
+    // Re-drive every access
+    double replay_ns = feeder.replay(records);
+
+    // Show what the trace contains
+    show_trace_summary(g.replay_file, header, records);
+    printf("Replayed against memory in %.3f ms (%.1f ns per access)\n",
+           replay_ns / 1e6, replay_ns / records.size());
 
-    if (current_frame_index < g.frame_data.size())
-        return current_frame_index;
+    // If there's no trace to compare against, we're done
+    if (g.compare_file.empty()) return;
 
-    // If we get here, there are no more frames of data
-    // available to send
-    return -1;
+    // Read the second trace and compare the two
+    reg_trace_header_t      header2;
+    vector<reg_trace_rec_t> records2;
+    read_reg_trace(g.compare_file, header2, records2);
+    compare_traces(header, records, header2, records2);
 }
 //=============================================================================
 
 
 
 //=============================================================================
-// This loads a FIFO, tells the RTL to start sending frames using the data
-// from that FIFO, and waits for the RTL to report that it has begun doing so
+// run_shm_benchmark() - Measures sustained frames/s through a shared-memory
+//                       ring between two processes.  A forked producer
+//                       fills and publishes frames as fast as it can, and
+//                       we write every word of every frame into a memory-
+//                       backed stand-in for a FIFO register, just as a job
+//                       would with word_delay_us = 0
 //=============================================================================
-bool start_fifo(uint32_t which)
+void run_shm_benchmark()
 {
-    // A pointer to the FIFO register
-    volatile uint32_t* fifo;
-    
-    // This will have a 1 in bit 0 or in bit 1
-    uint32_t           fifo_bit;
-
-    // Keep track of when this process starts
-    auto start_time = chrono::steady_clock::now();
-
-    // Determine the runtime parameters for this particular FIFO
-    if (which == 0)
-    {
-        fifo = g.reg_fifo0;
-        fifo_bit = 1 << 0;
-    }
-    else
+    const feeder_config_t& c = feeder.config;
+    ShmSource   source;
+    bce_frame_t frame;
+    uint64_t    dry = 0, bad = 0;
+    uint32_t    received = 0;
+
+    // Use the configured ring, or make one up
+    string name = c.shm_ring.empty() ? "/bce_feeder_bench" : c.shm_ring;
+
+    // Frames are a FIFO's worth of words, or as much as a slot holds
+    uint32_t words = c.fifo_depth ? c.fifo_depth : 4592;
+    if (words > c.shm_slot_words) words = c.shm_slot_words;
+
+    // Create the ring before the producer goes looking for it
+    source.start(name, c.shm_slots, c.shm_slot_words, 1);
+
+    // Fork the producer.  Each frame carries its sequence number, so we can
+    // tell if a frame is lost, duplicated or torn
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) throwRuntime("Can't fork the producer");
+    if (pid == 0)
     {
-        fifo = g.reg_fifo1;
-        fifo_bit = 1 << 1;
+        bce_shm_ring_t* ring = bce_shm_open(name.c_str(), 5000);
+        if (ring == nullptr) _exit(1);
+        for (uint32_t n = 0; n < g.shm_bench_frames; ++n)
+        {
+            uint32_t* data = bce_shm_acquire(ring, -1);
+            for (uint32_t i = 0; i < words; ++i) data[i] = n;
+            bce_shm_publish(ring, words, 1);
+        }
+        bce_shm_finish(ring);
+        bce_shm_close(ring);
+        _exit(0);
     }
 
-    // Reset the FIFO (i.e., remove any existing entries)
-    *g.reg_fifo_ctl = fifo_bit;
-    while (*g.reg_fifo_ctl) usleep(100);
+    // This stands in for a FIFO register
+    volatile uint32_t fifo;
 
-    // Find the index of the frame data we should load into the FIFO
-    int index = get_next_frame_index();
-
-    // If we have frame-data to load into the FIFO...
-    if (index >= 0 && *g.reg_abort == 0)
+    // Drain the ring, timing from the first frame to the last
+    auto start_time = chrono::steady_clock::now();
+    while (true)
     {
-        // Load the frame data into the FIFO
-        intvec_t& frame_data = g.frame_data[index];
-        for (uint32_t v : frame_data)
+        frame_status_t status = source.next_frame(frame, 1000000);
+        if (status == FRAME_END) break;
+        if (status == FRAME_EMPTY)
         {
-            *fifo = v;
-            usleep(25);
+            if (waitpid(pid, nullptr, WNOHANG) == pid) throwRuntime("The producer died");
+            ++dry;
+            continue;
         }
 
-        // Tell the RTL to put this FIFO "on deck"
-        *g.reg_fifo_select = fifo_bit;
-
-        // Keep track of when the "load FIFO" process completes
-        auto end_time = chrono::steady_clock::now();
-
-        // Compute the duration in milliseconds
-        auto duration = chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);        
-
-        // In verbose mode, show the load time
-        if (g.verbose)
-        {
-            printf("Loaded bright-cycle %i into FIFO %i (%lu ms)... ", index, which, duration.count());
-            fflush(stdout);
-        }
+        if (received == 0) start_time = chrono::steady_clock::now();
+        for (size_t i = 0; i < frame.size; ++i) fifo = frame.data[i];
+        if (frame.size != words || frame.data[0] != received || fifo != received) ++bad;
+        ++received;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    waitpid(pid, nullptr, 0);
+
+    printf("%s: %u slots of %u words\n", name.c_str(), c.shm_slots, c.shm_slot_words);
+    printf("Received %u frames of %u words in %.3f s\n", received, words, seconds);
+    printf("Sustained %.0f frames/s (%.1f MB/s)\n",
+           received / seconds, received * (double)words * 4 / seconds / 1e6);
+    printf("The ring was empty %lu times, %lu frames were damaged\n", dry, bad);
+}
+//=============================================================================
 
-        // Wait for the RTL to make this FIFO active
-        while (*g.reg_fifo_select != fifo_bit) usleep(1000);
 
-        // In verbose mode, show when the FIFO is in use
-        if (g.verbose) printf("started\n");
 
-        // And tell the caller that his FIFO is loaded and active
-        return true;
-    }
+//=============================================================================
+// serve_jobs() - Opens the device once, then runs the jobs that clients
+//                queue on the server socket until we're told to stop.
+//                Datasets stay in memory between jobs, so a job that sends
+//                a dataset again skips reading it
+//=============================================================================
+void serve_jobs()
+{
+    JobServer server(feeder);
 
-    // In verbose mode, tell the user we're stopping the job
-    if (g.verbose)
-    {
-        printf("Stopping job... "); fflush(stdout);
-    }
+    // Opening the device is the setup every job gets to skip
+    auto start_time = chrono::steady_clock::now();
+    feeder.open_device();
+    double open_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start_time).count();
 
-    // If we get here, we have no more frame-data to send and are
-    // stopping the job
-    *g.reg_fifo_select = 0;
-    while (*g.reg_fifo_select) usleep(1000);
+    server.start(g.serve_socket);
+    job_server = &server;
+    printf("Device opened in %.3f ms, serving jobs on %s\n", open_ms, g.serve_socket.c_str());
+    fflush(stdout);
 
-    // In verbose mode, tell the user we're done
-    if (g.verbose) printf("final frame sent, job complete\n");
+    server.run();
 
-    // Tell the caller that the job is complete
-    return false;
+    job_server = nullptr;
+    printf("Job server stopped\n");
 }
 //=============================================================================
 
 
+
 //=============================================================================
-// create_udp_server() - Returns the file-descriptor of an open UDP server socket
+// show_cadence_report() - Shows the period the job achieved, and how far
+//                         the intervals between FIFO hand-offs strayed
+//                         from the configured one
 //=============================================================================
-int create_udp_server(int port)
+void show_cadence_report()
 {
-    // Create the socket and complain if we can't
-    int sd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sd < 0)
-    {
-        throwRuntime("Failed while creating UDP socket");
-    }
+    bce_cadence_t c = feeder.cadence_report();
+    if (c.hand_offs < 2) return;
 
-    // Build the address structure of the UDP server
-    struct sockaddr_in serveraddr;
-    memset(&serveraddr, 0, sizeof(serveraddr));
-    serveraddr.sin_family = AF_INET;
-    serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
-    serveraddr.sin_port = htons((unsigned short)port);
-
-    // Bind the socket to the port
-    if (bind(sd, (struct sockaddr *) &serveraddr, sizeof(serveraddr)) < 0)
-    {
-        return -1;
-    }
+    printf
+    (
+        "Cadence: %lu hand-offs, period %.3f us (target %.3f us), jitter p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        c.hand_offs, c.period_us, c.target_period_us, c.jitter_p50_us, c.jitter_p99_us, c.jitter_max_us
+    );
 
-    // Return the socket descriptor to the caller
-    return sd;
+    if (c.missed_slots) printf("Cadence: %lu slots were missed because a FIFO wasn't ready in time\n", c.missed_slots);
 }
 //=============================================================================
-
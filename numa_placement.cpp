@@ -0,0 +1,226 @@
+//=================================================================================================
+// numa_placement.cpp - Implements tools for keeping the feeder and its frame-data on the NUMA
+//                      node that the BC_EMU card is attached to
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <fstream>
+#include <stdexcept>
+#include "numa_placement.h"
+using namespace std;
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+// The node masks we hand the kernel are a single unsigned long, which covers 64 nodes
+static const unsigned long MAX_NODES = 8 * sizeof(unsigned long);
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// describe_page_size() - Returns a page size in human-readable form, e.g. "2 MB"
+//=================================================================================================
+static string describe_page_size(size_t size)
+{
+    char buffer[32];
+    if (size >= (1 << 30))
+        sprintf(buffer, "%zu GB", size >> 30);
+    else if (size >= (1 << 20))
+        sprintf(buffer, "%zu MB", size >> 20);
+    else
+        sprintf(buffer, "%zu KB", size >> 10);
+    return buffer;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// allocate() - Allocates a block on the specified NUMA node, in the largest huge pages available
+//=================================================================================================
+uint32_t* FrameStore::allocate(size_t words, int node, bool huge_pages)
+{
+    const size_t huge_sizes[] = {size_t(1) << 30, size_t(2) << 20};
+    size_t bytes = words * sizeof(uint32_t);
+
+    release();
+    if (bytes == 0) bytes = 1;
+
+    // Try the huge page sizes from largest to smallest.  A size is only worth using if the
+    // block fills at least half of a page.  These fail quickly if the system has none reserved
+    if (huge_pages) for (size_t page : huge_sizes)
+    {
+        if (bytes < page / 2) continue;
+        size_t size  = (bytes + page - 1) & ~(page - 1);
+        int    flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | ((__builtin_ctzl(page)) << MAP_HUGE_SHIFT);
+        void*  p = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED) continue;
+        base_ = p;
+        size_ = size;
+        page_size_ = page;
+        break;
+    }
+
+    // Otherwise, use ordinary pages, and ask for transparent huge pages where the kernel can
+    if (base_ == nullptr)
+    {
+        page_size_ = sysconf(_SC_PAGESIZE);
+        size_ = (bytes + page_size_ - 1) & ~(page_size_ - 1);
+        void* p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throwRuntime("Can't allocate %zu bytes for frame-data", size_);
+        base_ = p;
+        transparent_ = huge_pages && madvise(base_, size_, MADV_HUGEPAGE) == 0;
+    }
+
+    // Set the block's policy before anything touches it, so every page is allocated on the
+    // node.  The node is preferred rather than required: a node that has run out of huge pages
+    // would otherwise kill us with SIGBUS when the page is first touched
+    if (node >= 0 && node < (int)MAX_NODES)
+    {
+        unsigned long mask = 1UL << node;
+        if (syscall(SYS_mbind, base_, size_, MPOL_PREFERRED, &mask, MAX_NODES, 0) < 0)
+        {
+            fprintf(stderr, "Warning: can't bind frame-data to NUMA node %i: %s\n", node, strerror(errno));
+        }
+    }
+
+    return (uint32_t*)base_;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// release() - Frees the block
+//=================================================================================================
+void FrameStore::release()
+{
+    if (base_) munmap(base_, size_);
+    base_ = nullptr;
+    size_ = 0;
+    page_size_ = 0;
+    transparent_ = false;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// swap() - Exchanges blocks with another FrameStore.  Pointers into either block stay valid
+//=================================================================================================
+void FrameStore::swap(FrameStore& other)
+{
+    std::swap(base_,        other.base_);
+    std::swap(size_,        other.size_);
+    std::swap(page_size_,   other.page_size_);
+    std::swap(transparent_, other.transparent_);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// placement() - Describes the size of the block, its pages, and the node its first page is on
+//=================================================================================================
+string FrameStore::placement() const
+{
+    char buffer[200];
+    if (base_ == nullptr) return "nothing allocated";
+
+    string pages = describe_page_size(page_size_) + " pages";
+    if (page_size_ > (size_t)sysconf(_SC_PAGESIZE)) pages = describe_page_size(page_size_) + " huge pages";
+    if (transparent_) pages += " (transparent huge pages allowed)";
+
+    int node = numa_node_of(base_);
+    if (node < 0)
+        sprintf(buffer, "%.1f MB in %s", size_ / 1048576.0, pages.c_str());
+    else
+        sprintf(buffer, "%.1f MB in %s on NUMA node %i", size_ / 1048576.0, pages.c_str(), node);
+    return buffer;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// numa_node_of() - Returns the NUMA node that holds the page at "address"
+//=================================================================================================
+int numa_node_of(const void* address)
+{
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0, address, MPOL_F_NODE | MPOL_F_ADDR) < 0)
+    {
+        return -1;
+    }
+    return node;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// pin_to_numa_node() - Pins the calling thread to the CPUs of a NUMA node, and makes that node
+//                      the preferred source of its memory.  Threads created afterwards inherit
+//                      both settings
+//
+// Returns: the node's list of CPUs, as sysfs describes it
+//=================================================================================================
+string pin_to_numa_node(int node)
+{
+    string    cpulist;
+    cpu_set_t cpus;
+
+    if (node < 0 || node >= (int)MAX_NODES) throwRuntime("Invalid NUMA node %i", node);
+
+    // Find out which CPUs belong to the node
+    string filename = "/sys/devices/system/node/node" + to_string(node) + "/cpulist";
+    ifstream file(filename);
+    if (!file.is_open() || !getline(file, cpulist)) throwRuntime("Can't read %s", filename.c_str());
+
+    // The list is made of comma-separated CPU numbers and ranges, e.g. "0-15,32-47"
+    CPU_ZERO(&cpus);
+    const char* p = cpulist.c_str();
+    while (*p)
+    {
+        char* end;
+        long first = strtol(p, &end, 10), last = first;
+        if (end == p) break;
+        if (*end == '-') last = strtol(end + 1, &end, 10);
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &cpus);
+        p = (*end == ',') ? end + 1 : end;
+    }
+    if (CPU_COUNT(&cpus) == 0) throwRuntime("NUMA node %i has no CPUs", node);
+
+    // Keep this thread on those CPUs
+    if (sched_setaffinity(0, sizeof cpus, &cpus) < 0)
+    {
+        throwRuntime("Can't pin to NUMA node %i: %s", node, strerror(errno));
+    }
+
+    // And prefer that node's memory for everything we allocate from here on
+    unsigned long mask = 1UL << node;
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, MAX_NODES) < 0)
+    {
+        throwRuntime("Can't set memory policy for NUMA node %i: %s", node, strerror(errno));
+    }
+
+    return cpulist;
+}
+//=================================================================================================
@@ -0,0 +1,71 @@
+//=================================================================================================
+// numa_placement.h - Defines tools for keeping the feeder and its frame-data on the NUMA node
+//                    that the BC_EMU card is attached to
+//
+// These use the kernel's memory-policy system calls directly, so there is no dependency on
+// libnuma.  On a machine with a single node, everything here still works; it just makes no
+// difference
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+//=================================================================================================
+// FrameStore - A single block of memory that holds every frame of a dataset, allocated on a
+//              chosen NUMA node in the largest huge pages that are available
+//=================================================================================================
+class FrameStore
+{
+public:
+
+    // Constructor and destructor
+    FrameStore() {}
+    ~FrameStore() {release();}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    FrameStore(const FrameStore&) = delete;
+    FrameStore& operator= (const FrameStore&) = delete;
+
+    // Allocates room for "words" 32-bit words, replacing any previous allocation
+    //
+    // Passed: words      = The number of 32-bit words to allocate
+    //         node       = The NUMA node the memory should come from, or -1 for any node
+    //         huge_pages = True to use 1 GB or 2 MB huge pages if the system has any
+    //
+    // Returns: a pointer to the block, which is aligned to a page
+    uint32_t* allocate(size_t words, int node, bool huge_pages);
+
+    // Frees the block
+    void    release();
+
+    // Exchanges blocks with another FrameStore
+    void    swap(FrameStore& other);
+
+    // Returns the page size the block is made of
+    size_t  page_size() const {return page_size_;}
+
+    // Returns a description of where the block ended up, e.g. "in 2 MB huge pages on node 0".
+    // Call this after the block has been written to, so the pages exist
+    std::string placement() const;
+
+protected:
+
+    // The mapped block and its size in bytes
+    void*   base_ = nullptr;
+    size_t  size_ = 0;
+
+    // The size of the pages it's made of, and whether they're transparent huge pages
+    size_t  page_size_ = 0;
+    bool    transparent_ = false;
+};
+//=================================================================================================
+
+
+// Pins the calling thread (and the threads it creates later) to the CPUs of a NUMA node, and
+// makes that node the preferred source of the memory those threads allocate.  Returns the list
+// of CPUs (e.g., "0-15,32-47").  Throws runtime_error on failure
+std::string pin_to_numa_node(int node);
+
+// Returns the NUMA node that holds the page at "address", or -1 if that can't be determined
+int     numa_node_of(const void* address);
@@ -0,0 +1,56 @@
+//=================================================================================================
+// parallel.h - Defines a simple way to spread independent work across every CPU
+//=================================================================================================
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <exception>
+
+
+//=================================================================================================
+// parallel_for() - Calls fn(i) for every i in [0, count), using one thread per CPU.  Each
+//                  thread repeatedly claims the next unprocessed index, so uneven amounts of
+//                  work per index balance out.
+//
+// If any call to fn() throws, the first exception is re-thrown to the caller once every
+// thread has finished
+//=================================================================================================
+template <class F> void parallel_for(size_t count, F fn)
+{
+    std::atomic<size_t> next_index{0};
+    std::exception_ptr  error;
+    std::atomic<bool>   failed{false};
+
+    // This is the work that each thread performs
+    auto worker = [&]()
+    {
+        size_t index;
+        while (!failed && (index = next_index++) < count)
+        {
+            try
+            {
+                fn(index);
+            }
+            catch(...)
+            {
+                if (!failed.exchange(true)) error = std::current_exception();
+            }
+        }
+    };
+
+    // Decide how many threads to use
+    size_t thread_count = std::thread::hardware_concurrency();
+    if (thread_count > count) thread_count = count;
+    if (thread_count == 0) thread_count = 1;
+
+    // Start the helper threads, do our share of the work, then wait for the helpers
+    std::vector<std::thread> threads;
+    for (size_t i=1; i<thread_count; ++i) threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads) thread.join();
+
+    // If anything went wrong, tell the caller
+    if (error) std::rethrow_exception(error);
+}
+//=================================================================================================
@@ -0,0 +1,189 @@
+//=================================================================================================
+// reg_trace.cpp - Implements a low-overhead recorder for device register accesses
+//=================================================================================================
+#include <unistd.h>
+#include <stdarg.h>
+#include <stdexcept>
+#include <chrono>
+#include "reg_trace.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// measure_tsc_hz() - Estimates the frequency of the timestamp counter by comparing it against
+//                    the steady clock over a short interval
+//=================================================================================================
+uint64_t RegTrace::measure_tsc_hz()
+{
+    auto     start_time = chrono::steady_clock::now();
+    uint64_t start_tsc  = read_tsc();
+
+    usleep(20000);
+
+    uint64_t end_tsc  = read_tsc();
+    auto     end_time = chrono::steady_clock::now();
+
+    // Compute the elapsed time in nanoseconds
+    auto ns = chrono::duration_cast<chrono::nanoseconds>(end_time - start_time).count();
+
+    // And hand the caller the number of ticks per second
+    return (end_tsc - start_tsc) * 1000000000ULL / ns;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start() - Creates the trace file and starts the background thread that writes to it
+//
+// Passed: filename  = The name of the trace file to create
+//         ring_size = The number of records the in-memory ring can hold (rounded up to a
+//                     power of two)
+//=================================================================================================
+void RegTrace::start(string filename, size_t ring_size)
+{
+    // If we're already recording, stop
+    stop();
+
+    // Create the trace file
+    file_ = fopen(filename.c_str(), "wb");
+    if (file_ == nullptr) throwRuntime("Can't create %s", filename.c_str());
+
+    // Write the file header
+    reg_trace_header_t header = {REG_TRACE_MAGIC, REG_TRACE_VERSION, sizeof(reg_trace_rec_t), 0};
+    header.tsc_hz = measure_tsc_hz();
+    fwrite(&header, sizeof header, 1, file_);
+
+    // Round the ring size up to a power of two
+    size_t size = 1;
+    while (size < ring_size) size <<= 1;
+
+    // Allocate the ring, and touch every page of it now rather than on the hot path
+    ring_.assign(size, reg_trace_rec_t{});
+    mask_ = size - 1;
+    head_ = 0;
+    tail_ = 0;
+    tail_cache_ = 0;
+    dropped_ = 0;
+
+    // Start the background thread that writes records to disk
+    running_ = true;
+    thread_ = std::thread(&RegTrace::flush_thread, this);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop() - Flushes any remaining records to disk and closes the trace file
+//=================================================================================================
+void RegTrace::stop()
+{
+    // If we're not recording, there's nothing to do
+    if (file_ == nullptr) return;
+
+    // Tell the background thread to quit, and wait for it to do so
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+
+    // Write out anything that arrived after the thread's last pass
+    drain();
+
+    // Close the trace file
+    fclose(file_);
+    file_ = nullptr;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// drain() - Writes every record that is currently in the ring to the trace file
+//=================================================================================================
+void RegTrace::drain()
+{
+    uint64_t tail = tail_.load(memory_order_relaxed);
+    uint64_t head = head_.load(memory_order_acquire);
+
+    while (tail != head)
+    {
+        // Write a contiguous run of records, stopping at the end of the ring
+        size_t index = tail & mask_;
+        size_t count = head - tail;
+        if (count > ring_.size() - index) count = ring_.size() - index;
+        fwrite(&ring_[index], sizeof(reg_trace_rec_t), count, file_);
+        tail += count;
+    }
+
+    // Tell the producer that those slots are free again
+    tail_.store(tail, memory_order_release);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// flush_thread() - Periodically drains the ring into the trace file until told to stop
+//=================================================================================================
+void RegTrace::flush_thread()
+{
+    while (running_)
+    {
+        drain();
+        usleep(1000);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_reg_trace() - Reads an entire trace file into memory
+//
+// Passed:  filename = The name of the trace file
+//
+// On Exit: header   = The header of the trace file
+//          records  = Every register access recorded in the file
+//=================================================================================================
+void read_reg_trace(string filename, reg_trace_header_t& header, vector<reg_trace_rec_t>& records)
+{
+    // Open the trace file
+    FILE* ifile = fopen(filename.c_str(), "rb");
+    if (ifile == nullptr) throwRuntime("can't read %s", filename.c_str());
+
+    // Read and validate the header
+    bool ok = fread(&header, sizeof header, 1, ifile) == 1
+           && header.magic == REG_TRACE_MAGIC
+           && header.version == REG_TRACE_VERSION
+           && header.record_size == sizeof(reg_trace_rec_t);
+    if (!ok)
+    {
+        fclose(ifile);
+        throwRuntime("%s is not a valid register trace", filename.c_str());
+    }
+
+    // Find out how many records the file contains
+    long header_end = ftell(ifile);
+    fseek(ifile, 0, SEEK_END);
+    size_t count = (ftell(ifile) - header_end) / sizeof(reg_trace_rec_t);
+    fseek(ifile, header_end, SEEK_SET);
+
+    // And read them all
+    records.resize(count);
+    count = fread(records.data(), sizeof(reg_trace_rec_t), count, ifile);
+    records.resize(count);
+
+    fclose(ifile);
+}
+//=================================================================================================
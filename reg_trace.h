@@ -0,0 +1,149 @@
+//=================================================================================================
+// reg_trace.h - Defines a low-overhead recorder for device register accesses
+//
+// Every traced register access is stored as a 16-byte record in a lock-free, single-producer/
+// single-consumer ring.  A background thread drains the ring into a binary trace file:
+//
+//    reg_trace_header_t    (once, at the start of the file)
+//    reg_trace_rec_t       (one per register access)
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// This is the "magic number" at the start of every trace file: "BCETRACE"
+const uint64_t REG_TRACE_MAGIC = 0x4543415254454342ULL;
+
+// The version of the trace file format
+const uint32_t REG_TRACE_VERSION = 1;
+
+// The high bit of "offset" in a trace record means "this was a write"
+const uint32_t REG_TRACE_WRITE = 0x80000000;
+
+// The header at the start of a trace file
+struct reg_trace_header_t
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t tsc_hz;
+};
+
+// A single register access
+struct reg_trace_rec_t
+{
+    uint64_t tsc;
+    uint32_t offset;        // Register offset, ORed with REG_TRACE_WRITE for writes
+    uint32_t value;         // The value read or written
+};
+
+
+//=================================================================================================
+// read_tsc() - Returns the CPU's free-running timestamp counter
+//=================================================================================================
+static inline uint64_t read_tsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// RegTrace - Records register accesses into an in-memory ring that is flushed to disk by a
+//            background thread
+//=================================================================================================
+class RegTrace
+{
+public:
+
+    // Constructor and destructor
+    RegTrace() {}
+    ~RegTrace() {stop();}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    RegTrace(const RegTrace&) = delete;
+    RegTrace& operator= (const RegTrace&) = delete;
+
+    // Creates the trace file and starts the background thread that writes to it
+    void    start(std::string filename, size_t ring_size = 1 << 20);
+
+    // Flushes any remaining records to disk and closes the trace file
+    void    stop();
+
+    // Returns true if we're currently recording
+    bool    is_active() {return file_ != nullptr;}
+
+    // Returns the number of records that were discarded because the ring was full
+    uint64_t dropped() {return dropped_;}
+
+    // Records a register access.  This never blocks: if the ring is full, the record is dropped
+    inline void record(uint32_t offset, uint32_t value, bool is_write)
+    {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ > mask_)
+        {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head - tail_cache_ > mask_) {++dropped_; return;}
+        }
+        reg_trace_rec_t& rec = ring_[head & mask_];
+        rec.tsc    = read_tsc();
+        rec.offset = is_write ? offset | REG_TRACE_WRITE : offset;
+        rec.value  = value;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Estimates the frequency of the timestamp counter
+    static uint64_t measure_tsc_hz();
+
+protected:
+
+    // The background thread that drains the ring into the trace file
+    void    flush_thread();
+
+    // Writes every record currently in the ring to the trace file
+    void    drain();
+
+    // The ring of trace records.  The size is always a power of two
+    std::vector<reg_trace_rec_t> ring_;
+    uint64_t mask_ = 0;
+
+    // The producer's index and its cached copy of the consumer's index
+    alignas(64) std::atomic<uint64_t> head_{0};
+    uint64_t tail_cache_ = 0;
+    uint64_t dropped_ = 0;
+
+    // The consumer's index
+    alignas(64) std::atomic<uint64_t> tail_{0};
+
+    // The background thread and the flag that tells it to quit
+    std::thread       thread_;
+    std::atomic<bool> running_{false};
+
+    // The trace file
+    FILE*   file_ = nullptr;
+};
+//=================================================================================================
+
+
+// Reads an entire trace file into memory.  Throws runtime_error on failure
+void read_reg_trace(std::string filename, reg_trace_header_t& header,
+                    std::vector<reg_trace_rec_t>& records);
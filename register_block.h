@@ -0,0 +1,244 @@
+//=================================================================================================
+// register_block.h - Defines the BC_EMU register map, and a register block whose access method
+//                    is chosen at compile time
+//
+// A RegisterBlock<Access> holds a pointer to every BC_EMU register.  Every read and write goes
+// through the "Access" policy, which decides what an access does:
+//
+//      MmioAccess      A plain volatile load or store, and nothing else
+//      TracedAccess    Also records the access in a RegTrace
+//      CountingAccess  Also counts the reads and writes of every register
+//      MemoryAccess    Like MmioAccess, against a memory-backed stand-in that the block owns
+//
+// The policy's functions are inlined into the caller, so a loop written against one particular
+// RegisterBlock<> compiles to exactly what it would if it had been written by hand for that
+// backend
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "reg_trace.h"
+
+// The BC_EMU registers
+enum reg_id_t
+{
+    REG_RTL_MAJOR,
+    REG_RTL_MINOR,
+    REG_RTL_ID,
+    REG_FIFO0,
+    REG_FIFO1,
+    REG_FIFO_CTL,
+    REG_FIFO_SELECT,
+    REG_CONT_MODE,
+    REG_ABORT,
+    REG_BC_COUNT,
+    REG_FIFO0_LEVEL,
+    REG_FIFO1_LEVEL,
+    REG_FIFO_STATUS,
+    REG_COUNT
+};
+
+
+//=================================================================================================
+// register_map_t - The offset of every register within the register space
+//=================================================================================================
+struct register_map_t
+{
+    uint32_t offset[REG_COUNT];
+
+    // Access to the offset of a single register
+    constexpr uint32_t  operator[](reg_id_t id) const {return offset[id];}
+    uint32_t&           operator[](reg_id_t id)       {return offset[id];}
+
+    // Returns the name of a register.  In bce_feeder.conf, its offset is "reg_<name>"
+    static constexpr const char* name(reg_id_t id)
+    {
+        constexpr const char* names[REG_COUNT] =
+        {
+            "rtl_major",   "rtl_minor", "rtl_id",   "fifo0",       "fifo1",       "fifo_ctl",
+            "fifo_select", "cont_mode", "abort",    "bc_count",    "fifo0_level", "fifo1_level",
+            "fifo_status"
+        };
+        return names[id];
+    }
+
+    // Returns the size (in bytes) of a register space that holds every register
+    constexpr uint32_t span() const
+    {
+        uint32_t result = 0;
+        for (auto value : offset) if (value + 4 > result) result = value + 4;
+        return result;
+    }
+};
+
+// The BC_EMU register layout as the RTL is built.  Any of these can be overridden in
+// bce_feeder.conf.  The RTL documentation gives no offsets for the FIFO fill-level and status
+// registers, so they're 0 ("not configured") until bce_feeder.conf says where they are
+constexpr register_map_t BC_EMU_REGISTERS =
+{{
+    0x0000,     // rtl_major
+    0x0004,     // rtl_minor
+    0x0014,     // rtl_id
+    0x1008,     // fifo0
+    0x100C,     // fifo1
+    0x1004,     // fifo_ctl
+    0x1010,     // fifo_select
+    0x1014,     // cont_mode
+    0x107C,     // abort
+    0x1078,     // bc_count
+    0,          // fifo0_level
+    0,          // fifo1_level
+    0,          // fifo_status
+}};
+//=================================================================================================
+
+
+//=================================================================================================
+// Access policies.  Each one provides:
+//
+//      uint8_t* attach(uint8_t* base, uint32_t span)   Returns the register space to use
+//      uint32_t read  (volatile uint32_t* reg, uint32_t offset)
+//      void     write (volatile uint32_t* reg, uint32_t offset, uint32_t value)
+//=================================================================================================
+
+// Direct memory-mapped I/O
+struct MmioAccess
+{
+    uint8_t* attach(uint8_t* base, uint32_t span) {return base;}
+
+    uint32_t read(volatile uint32_t* reg, uint32_t offset) {return *reg;}
+
+    void     write(volatile uint32_t* reg, uint32_t offset, uint32_t value) {*reg = value;}
+};
+
+// Memory-mapped I/O, recording every access in a register trace
+struct TracedAccess : MmioAccess
+{
+    RegTrace* trace = nullptr;
+
+    uint32_t read(volatile uint32_t* reg, uint32_t offset)
+    {
+        uint32_t value = *reg;
+        trace->record(offset, value, false);
+        return value;
+    }
+
+    void     write(volatile uint32_t* reg, uint32_t offset, uint32_t value)
+    {
+        *reg = value;
+        trace->record(offset, value, true);
+    }
+};
+
+// Memory-mapped I/O, counting the reads and writes of every register
+struct CountingAccess : MmioAccess
+{
+    // Indexed by offset / 4
+    std::vector<uint64_t> reads, writes;
+
+    uint8_t* attach(uint8_t* base, uint32_t span)
+    {
+        reads.assign(span / 4, 0);
+        writes.assign(span / 4, 0);
+        return base;
+    }
+
+    uint32_t read(volatile uint32_t* reg, uint32_t offset)
+    {
+        ++reads[offset >> 2];
+        return *reg;
+    }
+
+    void     write(volatile uint32_t* reg, uint32_t offset, uint32_t value)
+    {
+        ++writes[offset >> 2];
+        *reg = value;
+    }
+};
+
+// A memory-backed stand-in for the register space, with every register initially zero.  The
+// registers are still accessed as volatile, so another thread can play the part of the RTL
+struct MemoryAccess : MmioAccess
+{
+    std::vector<uint32_t> storage;
+
+    uint8_t* attach(uint8_t* base, uint32_t span)
+    {
+        storage.assign(span / 4 + 1, 0);
+        return (uint8_t*)storage.data();
+    }
+};
+//=================================================================================================
+
+
+//=================================================================================================
+// RegisterBlock - The BC_EMU registers, accessed through the "Access" policy
+//=================================================================================================
+template <class Access> class RegisterBlock : public Access
+{
+public:
+
+    // Points the block at a register space
+    //
+    // Passed: base = The userspace address of the register space (ignored by MemoryAccess)
+    //         map  = The offset of every register
+    //         span = The minimum size of the register space, in bytes
+    void attach(uint8_t* base, const register_map_t& map, uint32_t span = 0)
+    {
+        if (span < map.span()) span = map.span();
+        map_  = map;
+        base_ = Access::attach(base, span);
+        for (int id = 0; id < REG_COUNT; ++id)
+        {
+            reg_[id] = (volatile uint32_t*)(base_ + map_.offset[id]);
+        }
+    }
+
+    // Forgets the register space
+    void detach() {base_ = nullptr;}
+
+    // Returns the start of the register space, or nullptr if the block isn't attached
+    uint8_t* base() const {return base_;}
+
+    // Returns the register map
+    const register_map_t& map() const {return map_;}
+
+    // Reads and writes a register
+    uint32_t read(reg_id_t id)
+    {
+        return Access::read(reg_[id], map_.offset[id]);
+    }
+
+    void     write(reg_id_t id, uint32_t value)
+    {
+        Access::write(reg_[id], map_.offset[id], value);
+    }
+
+    // Reads and writes the register at an arbitrary offset
+    uint32_t read_offset(uint32_t offset)
+    {
+        return Access::read((volatile uint32_t*)(base_ + offset), offset);
+    }
+
+    void     write_offset(uint32_t offset, uint32_t value)
+    {
+        Access::write((volatile uint32_t*)(base_ + offset), offset, value);
+    }
+
+    // Writes a block of words, one after another, into a single register (i.e., a FIFO)
+    void     write_block(reg_id_t id, const uint32_t* data, size_t count)
+    {
+        volatile uint32_t* reg = reg_[id];
+        uint32_t offset = map_.offset[id];
+        for (size_t i=0; i<count; ++i) Access::write(reg, offset, data[i]);
+    }
+
+protected:
+
+    // The register space, the register map, and a pointer to each register
+    uint8_t*           base_ = nullptr;
+    register_map_t     map_ = BC_EMU_REGISTERS;
+    volatile uint32_t* reg_[REG_COUNT] = {};
+};
+//=================================================================================================
@@ -0,0 +1,140 @@
+//=================================================================================================
+// shm_ring.cpp - Implements the producer side of the shared-memory frame ring
+//=================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+#include "shm_ring.h"
+using namespace std;
+
+// This is what a bce_shm_ring_t handle points to
+struct bce_shm_ring
+{
+    bce_shm_header_t* header;
+    size_t            size;
+
+    // The number of slots we have published, and our cached copy of the consumer's "tail"
+    uint64_t          head;
+    uint64_t          tail_cache;
+};
+
+
+//=================================================================================================
+// slot() - Returns a pointer to the slot that holds the frame with the specified sequence number
+//=================================================================================================
+static inline bce_shm_slot_t* slot(bce_shm_header_t* header, uint64_t sequence)
+{
+    uint8_t* base = (uint8_t*)header + sizeof(bce_shm_header_t);
+    return (bce_shm_slot_t*)(base + (sequence % header->slot_count) * header->slot_stride);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_shm_open() - Attaches to a ring that the feeder has created
+//=================================================================================================
+bce_shm_ring_t* bce_shm_open(const char* name, int timeout_ms)
+{
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    struct stat st;
+    int fd;
+
+    // Wait for the feeder to create the ring and finish initializing its header
+    while (true)
+    {
+        fd = shm_open(name, O_RDWR, 0);
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(bce_shm_header_t))
+        {
+            void* p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) return nullptr;
+
+            auto header = (bce_shm_header_t*)p;
+            if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == BCE_SHM_MAGIC)
+            {
+                if (header->version != BCE_SHM_VERSION) {munmap(p, st.st_size); return nullptr;}
+                uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+                return new bce_shm_ring{header, (size_t)st.st_size, head, 0};
+            }
+            munmap(p, st.st_size);
+        }
+        else if (fd >= 0) ::close(fd);
+
+        if (chrono::steady_clock::now() >= deadline) return nullptr;
+        usleep(1000);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_shm_slot_words() - Returns the capacity of each slot, in 32-bit words
+//=================================================================================================
+uint32_t bce_shm_slot_words(bce_shm_ring_t* ring)
+{
+    return ring->header->slot_words;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_shm_acquire() - Returns the data area of the next free slot, waiting for the feeder to
+//                     release one if the ring is full
+//=================================================================================================
+uint32_t* bce_shm_acquire(bce_shm_ring_t* ring, int timeout_us)
+{
+    bce_shm_header_t* header = ring->header;
+    auto deadline = chrono::steady_clock::now() + chrono::microseconds(timeout_us);
+
+    for (int spins = 0; ring->head - ring->tail_cache >= header->slot_count; ++spins)
+    {
+        // Only touch the consumer's cache-line when our cached copy says the ring is full
+        ring->tail_cache = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+        if (ring->head - ring->tail_cache < header->slot_count) break;
+
+        // Give the feeder a chance to run, then back off to sleeping
+        if (timeout_us >= 0 && chrono::steady_clock::now() >= deadline) return nullptr;
+        if (spins < 100) sched_yield(); else usleep(20);
+    }
+
+    return slot(header, ring->head)->data;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_shm_publish() - Hands the slot returned by bce_shm_acquire() to the feeder
+//=================================================================================================
+void bce_shm_publish(bce_shm_ring_t* ring, uint32_t words, uint32_t repeat)
+{
+    bce_shm_slot_t* s = slot(ring->header, ring->head);
+    s->words  = words;
+    s->repeat = repeat;
+    __atomic_store_n(&ring->header->head, ++ring->head, __ATOMIC_RELEASE);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_shm_finish() - Tells the feeder there will be no more frames
+//=================================================================================================
+void bce_shm_finish(bce_shm_ring_t* ring)
+{
+    __atomic_store_n(&ring->header->finished, 1, __ATOMIC_RELEASE);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bce_shm_close() - Detaches from the ring
+//=================================================================================================
+void bce_shm_close(bce_shm_ring_t* ring)
+{
+    if (ring == nullptr) return;
+    munmap(ring->header, ring->size);
+    delete ring;
+}
+//=================================================================================================
@@ -0,0 +1,88 @@
+//=================================================================================================
+// shm_ring.h - Defines the layout of the shared-memory frame ring, and the interface that a
+//              producer process uses to write frames into it
+//
+// The feeder creates the ring as a POSIX shared-memory object.  A producer process attaches to
+// it, writes each frame directly into a free slot, and publishes the slot.  The feeder loads the
+// FIFO straight from the slot, then releases it back to the producer.  The ring is lock-free,
+// with exactly one producer and one consumer:
+//
+//      bce_shm_header_t        (once, at the start of the object)
+//      bce_shm_slot_t          (slot_count times, each slot_stride bytes apart)
+//
+// A typical producer:
+//
+//      bce_shm_ring_t* ring = bce_shm_open("/bce_frames", 5000);
+//      while (more_frames)
+//      {
+//          uint32_t* slot = bce_shm_acquire(ring, -1);
+//          uint32_t  words = compute_frame(slot, bce_shm_slot_words(ring));
+//          bce_shm_publish(ring, words, 1);
+//      }
+//      bce_shm_finish(ring);
+//      bce_shm_close(ring);
+//
+// This header can be used from C or C++.  The functions are in libbcefeeder
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// This is the "magic number" at the start of the ring: "BCERING"
+#define BCE_SHM_MAGIC   0x00474E4952454342ULL
+
+// The version of the ring layout
+#define BCE_SHM_VERSION 1
+
+// The header at the start of the shared-memory object.  "head" and "tail" are on cache-lines of
+// their own, so the producer and consumer never write to the same cache-line
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_count;        // The number of slots in the ring
+    uint32_t slot_words;        // The capacity of each slot, in 32-bit words
+    uint32_t slot_stride;       // The distance in bytes from one slot to the next
+    uint32_t finished;          // Set by the producer once it has published its last frame
+
+    uint64_t head __attribute__((aligned(64)));    // Slots published, written by the producer
+    uint64_t tail __attribute__((aligned(64)));    // Slots released, written by the consumer
+} __attribute__((aligned(64))) bce_shm_header_t;
+
+// A single slot.  The frame-data starts on a cache-line boundary
+typedef struct
+{
+    uint32_t words;             // The number of words in the frame
+    uint32_t repeat;            // The number of times to send it, or 0 for the configured default
+    uint32_t data[] __attribute__((aligned(64)));
+} bce_shm_slot_t;
+
+// A producer's connection to a ring
+typedef struct bce_shm_ring bce_shm_ring_t;
+
+// Attaches to the ring called "name", waiting up to "timeout_ms" for the feeder to create it.
+// Returns NULL on failure
+bce_shm_ring_t* bce_shm_open(const char* name, int timeout_ms);
+
+// Returns the capacity of each slot, in 32-bit words
+uint32_t        bce_shm_slot_words(bce_shm_ring_t* ring);
+
+// Returns the data area of the next free slot, waiting up to "timeout_us" for the feeder to
+// free one (-1 = wait forever).  Returns NULL if no slot became free in time
+uint32_t*       bce_shm_acquire(bce_shm_ring_t* ring, int timeout_us);
+
+// Hands the slot returned by bce_shm_acquire() to the feeder
+void            bce_shm_publish(bce_shm_ring_t* ring, uint32_t words, uint32_t repeat);
+
+// Tells the feeder there will be no more frames
+void            bce_shm_finish(bce_shm_ring_t* ring);
+
+// Detaches from the ring
+void            bce_shm_close(bce_shm_ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,154 @@
+//=================================================================================================
+// shm_source.cpp - Implements a frame source that takes frames from a shared-memory ring written
+//                  by a producer process
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <stdexcept>
+#include <chrono>
+#include "shm_source.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start() - Creates the shared-memory object, maps it, and initializes the ring
+//=================================================================================================
+void ShmSource::start(string name, uint32_t slot_count, uint32_t slot_words, uint32_t default_repeat)
+{
+    // If we already have a ring, get rid of it
+    stop();
+
+    if (slot_count == 0) throwRuntime("shm_slots must be non-zero");
+    if (slot_words == 0) throwRuntime("shm_slot_words must be non-zero");
+
+    // Each slot is a whole number of cache-lines
+    size_t stride = sizeof(bce_shm_slot_t) + slot_words * sizeof(uint32_t);
+    stride = (stride + 63) & ~(size_t)63;
+    size_t size = sizeof(bce_shm_header_t) + stride * slot_count;
+    if (stride > UINT32_MAX) throwRuntime("shm_slot_words is too large");
+
+    // Create the object, replacing any stale one left by a previous run
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) throwRuntime("Can't create shared memory %s: %s", name.c_str(), strerror(errno));
+    if (ftruncate(fd, size) < 0)
+    {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throwRuntime("Can't size shared memory %s: %s", name.c_str(), strerror(errno));
+    }
+
+    // Map it
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        throwRuntime("Can't map shared memory %s: %s", name.c_str(), strerror(errno));
+    }
+
+    // Fill in the header.  The magic number goes in last: producers wait for it
+    header_ = (bce_shm_header_t*)p;
+    header_->version     = BCE_SHM_VERSION;
+    header_->slot_count  = slot_count;
+    header_->slot_words  = slot_words;
+    header_->slot_stride = stride;
+    __atomic_store_n(&header_->magic, BCE_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    // Start with an empty ring
+    size_           = size;
+    name_           = name;
+    next_           = 0;
+    head_cache_     = 0;
+    holding_        = false;
+    remaining_      = 0;
+    default_repeat_ = default_repeat ? default_repeat : 1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop() - Unmaps the ring and removes the shared-memory object
+//=================================================================================================
+void ShmSource::stop()
+{
+    // If we don't have a ring, there's nothing to do
+    if (header_ == nullptr) return;
+
+    munmap(header_, size_);
+    shm_unlink(name_.c_str());
+    header_ = nullptr;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// next_frame() - Fetches the next frame to send.  A frame is handed out once for every time it
+//                is to be sent, and its slot is released once the next frame is handed out
+//=================================================================================================
+frame_status_t ShmSource::next_frame(bce_frame_t& frame, uint32_t wait_us)
+{
+    // If the current frame is to be sent again, hand it out again
+    if (remaining_)
+    {
+        --remaining_;
+        frame = current_;
+        return FRAME_READY;
+    }
+
+    auto deadline = chrono::steady_clock::now() + chrono::microseconds(wait_us);
+
+    // Wait (if we were asked to) for the producer to publish a frame.  Our cached copy of
+    // "head" saves us from touching the producer's cache-line for every frame
+    for (int spins = 0; next_ == head_cache_; ++spins)
+    {
+        // Check "finished" first: once it's set, "head" will never move again
+        bool finished = __atomic_load_n(&header_->finished, __ATOMIC_ACQUIRE);
+        head_cache_ = __atomic_load_n(&header_->head, __ATOMIC_ACQUIRE);
+        if (next_ != head_cache_) break;
+        if (finished) return FRAME_END;
+
+        // Give the producer a chance to run, then back off to sleeping
+        if (chrono::steady_clock::now() >= deadline) return FRAME_EMPTY;
+        if (spins < 100) sched_yield(); else usleep(20);
+    }
+
+    // The previous frame won't be needed again, so give its slot back to the producer
+    if (holding_) __atomic_store_n(&header_->tail, next_, __ATOMIC_RELEASE);
+
+    // The next slot holds the new current frame
+    bce_shm_slot_t* s = slot(next_++);
+    holding_ = true;
+    if (s->words > header_->slot_words)
+    {
+        throwRuntime("%s: a slot claims to hold %u words", name_.c_str(), s->words);
+    }
+    current_   = {s->data, s->words};
+    remaining_ = (s->repeat ? s->repeat : default_repeat_) - 1;
+
+    frame = current_;
+    return FRAME_READY;
+}
+//=================================================================================================
@@ -0,0 +1,69 @@
+//=================================================================================================
+// shm_source.h - Defines a frame source that takes frames from a shared-memory ring written by a
+//                producer process
+//
+// We create the ring; the producer attaches to it through the interface in shm_ring.h.  Frames
+// are handed out as pointers into the ring's slots, so the FIFOs are loaded straight from shared
+// memory without the frame-data ever being copied.  A slot is given back to the producer when
+// the frame after it is handed out
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include "frame_source.h"
+#include "shm_ring.h"
+
+class ShmSource : public FrameSource
+{
+public:
+
+    // Constructor and destructor
+    ShmSource() {}
+    ~ShmSource() {stop();}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    ShmSource(const ShmSource&) = delete;
+    ShmSource& operator= (const ShmSource&) = delete;
+
+    // Creates the ring
+    //
+    // Passed: name           = The name of the POSIX shared-memory object (e.g., "/bce_frames")
+    //         slot_count     = The number of slots in the ring
+    //         slot_words     = The capacity of each slot, in 32-bit words
+    //         default_repeat = How many times to send frames published with "repeat = 0"
+    void    start(std::string name, uint32_t slot_count, uint32_t slot_words, uint32_t default_repeat);
+
+    // Unmaps the ring and removes the shared-memory object
+    void    stop();
+
+    // Fetches the next frame from the ring
+    frame_status_t next_frame(bce_frame_t& frame, uint32_t wait_us) override;
+
+protected:
+
+    // Returns a pointer to the slot that holds the frame with the specified sequence number
+    bce_shm_slot_t* slot(uint64_t sequence)
+    {
+        uint8_t* base = (uint8_t*)header_ + sizeof(bce_shm_header_t);
+        return (bce_shm_slot_t*)(base + (sequence % header_->slot_count) * header_->slot_stride);
+    }
+
+    // The mapped ring, its size in bytes, and its name
+    bce_shm_header_t* header_ = nullptr;
+    size_t            size_ = 0;
+    std::string       name_;
+
+    // The sequence number of the next frame to take, and our cached copy of the producer's "head"
+    uint64_t          next_ = 0;
+    uint64_t          head_cache_ = 0;
+
+    // True if we're holding a slot (the frame being sent) that hasn't been released yet
+    bool              holding_ = false;
+
+    // The frame being sent, and the number of times it has yet to be sent
+    bce_frame_t       current_ = {};
+    uint32_t          remaining_ = 0;
+
+    // How many times to send a frame whose slot doesn't say
+    uint32_t          default_repeat_ = 1;
+};
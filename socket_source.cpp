@@ -0,0 +1,249 @@
+//=================================================================================================
+// socket_source.cpp - Implements a frame source that receives frames from producer processes over
+//                     a unix-domain stream socket
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdexcept>
+#include <chrono>
+#include "socket_source.h"
+using namespace std;
+
+// A frame bigger than this (in words) is assumed to be a corrupt header
+static const uint32_t MAX_FRAME_WORDS = 1 << 26;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read_fully() - Reads exactly "length" bytes from a socket
+//
+// Returns: false if the connection closed (or failed) first
+//=================================================================================================
+static bool read_fully(int sd, void* buffer, size_t length)
+{
+    uint8_t* p = (uint8_t*)buffer;
+
+    while (length)
+    {
+        ssize_t count = recv(sd, p, length, MSG_WAITALL);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        p      += count;
+        length -= count;
+    }
+
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start() - Creates the socket and starts the thread that receives frames from it
+//=================================================================================================
+void SocketSource::start(string path, size_t queue_depth, uint32_t default_repeat)
+{
+    sockaddr_un addr = {};
+
+    // If we're already listening, stop
+    stop();
+
+    if (path.size() >= sizeof(addr.sun_path)) throwRuntime("Socket name %s is too long", path.c_str());
+    if (queue_depth == 0) throwRuntime("queue_depth must be non-zero");
+
+    // Create the socket, replacing any stale one left by a previous run
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) throwRuntime("Failed while creating socket %s", path.c_str());
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(listen_fd_, (sockaddr*)&addr, sizeof addr) < 0 || listen(listen_fd_, 1) < 0)
+    {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        throwRuntime("Can't listen on %s: %s", path.c_str(), strerror(errno));
+    }
+
+    // Start with an empty queue
+    path_           = path;
+    queue_depth_    = queue_depth;
+    default_repeat_ = default_repeat ? default_repeat : 1;
+    end_of_stream_  = false;
+    remaining_      = 0;
+    queue_.clear();
+
+    // And start receiving frames
+    running_ = true;
+    thread_ = std::thread(&SocketSource::receive_thread, this);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop() - Stops the receive thread, closes the socket and removes it from the filesystem
+//=================================================================================================
+void SocketSource::stop()
+{
+    // If we're not listening, there's nothing to do
+    if (listen_fd_ < 0) return;
+
+    // Wake the receive thread, wherever it's blocked, and wait for it to quit
+    running_ = false;
+    shutdown(listen_fd_, SHUT_RDWR);
+    int sd = conn_fd_;
+    if (sd >= 0) shutdown(sd, SHUT_RDWR);
+    {
+        lock_guard<mutex> lock(mutex_);
+        not_full_.notify_all();
+    }
+    if (thread_.joinable()) thread_.join();
+
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(path_.c_str());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// receive_thread() - Accepts producers one at a time, and receives frames from each until it
+//                    disconnects.  After the end-of-stream marker, no more producers are accepted
+//=================================================================================================
+void SocketSource::receive_thread()
+{
+    while (running_ && !end_of_stream_)
+    {
+        // Wait for a producer to connect
+        int sd = accept(listen_fd_, nullptr, nullptr);
+        if (sd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+
+        // Receive frames until the producer is done
+        conn_fd_ = sd;
+        while (running_ && receive_frame(sd));
+        conn_fd_ = -1;
+        ::close(sd);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// receive_frame() - Receives a single frame from a producer and appends it to the queue, waiting
+//                   for room in the queue if necessary
+//
+// Returns: false if the producer disconnected or sent the end-of-stream marker
+//=================================================================================================
+bool SocketSource::receive_frame(int sd)
+{
+    bce_frame_msg_t header;
+    intvec_t        buffer;
+
+    // Fetch the header
+    if (!read_fully(sd, &header, sizeof header)) return false;
+
+    // A frame with no words means the producer has no more frames for us
+    if (header.words == 0)
+    {
+        lock_guard<mutex> lock(mutex_);
+        end_of_stream_ = true;
+        not_empty_.notify_all();
+        return false;
+    }
+
+    // If the header is nonsense, drop this producer
+    if (header.words > MAX_FRAME_WORDS)
+    {
+        fprintf(stderr, "%s: dropping producer that sent a %u-word frame\n", path_.c_str(), header.words);
+        return false;
+    }
+
+    // Re-use the buffer of a frame we've already sent, if there is one
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (!pool_.empty())
+        {
+            buffer = std::move(pool_.back());
+            pool_.pop_back();
+        }
+    }
+
+    // Receive the frame-data straight into the buffer
+    buffer.resize(header.words);
+    if (!read_fully(sd, buffer.data(), header.words * sizeof(uint32_t))) return false;
+
+    // Wait for room in the queue.  While we wait we aren't reading the socket, which is what
+    // makes the producer wait too
+    unique_lock<mutex> lock(mutex_);
+    not_full_.wait(lock, [this]() {return queue_.size() < queue_depth_ || !running_;});
+    if (!running_) return false;
+
+    // Add the frame to the queue
+    queue_.push_back({std::move(buffer), header.repeat ? header.repeat : default_repeat_});
+    not_empty_.notify_one();
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// next_frame() - Fetches the next frame to send.  A frame is handed out once for every time it
+//                is to be sent, and its buffer is recycled once it has been sent for good
+//=================================================================================================
+frame_status_t SocketSource::next_frame(bce_frame_t& frame, uint32_t wait_us)
+{
+    unique_lock<mutex> lock(mutex_);
+
+    // If the current frame is to be sent again, hand it out again
+    if (remaining_)
+    {
+        --remaining_;
+        frame = {current_.data(), current_.size()};
+        return FRAME_READY;
+    }
+
+    // If we were asked to, wait a while for a frame to arrive
+    if (wait_us)
+    {
+        auto ready = [this]() {return !queue_.empty() || end_of_stream_;};
+        not_empty_.wait_for(lock, chrono::microseconds(wait_us), ready);
+    }
+
+    // If there's nothing in the queue, tell the caller whether there ever will be
+    if (queue_.empty()) return end_of_stream_ ? FRAME_END : FRAME_EMPTY;
+
+    // The previous frame won't be needed again, so keep its buffer for re-use
+    if (current_.capacity()) pool_.push_back(std::move(current_));
+
+    // The frame at the head of the queue becomes the current frame
+    current_   = std::move(queue_.front().data);
+    remaining_ = queue_.front().repeat - 1;
+    queue_.pop_front();
+    not_full_.notify_one();
+
+    frame = {current_.data(), current_.size()};
+    return FRAME_READY;
+}
+//=================================================================================================
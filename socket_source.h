@@ -0,0 +1,87 @@
+//=================================================================================================
+// socket_source.h - Defines a frame source that receives frames from producer processes over a
+//                   unix-domain stream socket
+//
+// Each frame arrives as a bce_frame_msg_t header followed by "words" 32-bit words in host byte
+// order.  A header with "words" = 0 marks the end of the stream.  Received frames wait in a
+// bounded queue; when the queue is full we stop reading the socket, so the producer blocks
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include "frame_source.h"
+#include "frame_reader.h"
+
+class SocketSource : public FrameSource
+{
+public:
+
+    // Constructor and destructor
+    SocketSource() {}
+    ~SocketSource() {stop();}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    SocketSource(const SocketSource&) = delete;
+    SocketSource& operator= (const SocketSource&) = delete;
+
+    // Starts listening for producers
+    //
+    // Passed: path           = The filename of the socket
+    //         queue_depth    = The maximum number of frames that may wait in the queue
+    //         default_repeat = How many times to send frames whose header says "repeat = 0"
+    void    start(std::string path, size_t queue_depth, uint32_t default_repeat);
+
+    // Stops listening and removes the socket
+    void    stop();
+
+    // Fetches the next frame from the queue
+    frame_status_t next_frame(bce_frame_t& frame, uint32_t wait_us) override;
+
+protected:
+
+    // The background thread that accepts producers and receives their frames
+    void    receive_thread();
+
+    // Receives one frame from a producer.  Returns false when the producer is finished
+    bool    receive_frame(int sd);
+
+    // A frame waiting to be sent, and the number of times to send it
+    struct queued_t
+    {
+        intvec_t data;
+        uint32_t repeat;
+    };
+
+    // The queue of received frames, and the signals between the two threads
+    std::deque<queued_t>    queue_;
+    std::mutex              mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    size_t                  queue_depth_ = 0;
+    bool                    end_of_stream_ = false;
+
+    // Buffers from frames that have been sent, for re-use
+    std::vector<intvec_t>   pool_;
+
+    // The frame being sent, and the number of times it has yet to be sent
+    intvec_t                current_;
+    uint32_t                remaining_ = 0;
+
+    // How many times to send a frame whose header doesn't say
+    uint32_t                default_repeat_ = 1;
+
+    // The listening socket, the connection to the current producer, and the socket's filename
+    int                     listen_fd_ = -1;
+    std::atomic<int>        conn_fd_{-1};
+    std::string             path_;
+
+    // The receive thread and the flag that tells it to quit
+    std::thread             thread_;
+    std::atomic<bool>       running_{false};
+};
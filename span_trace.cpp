@@ -0,0 +1,186 @@
+//=================================================================================================
+// span_trace.cpp - Implements a recorder of timed spans that is written out as Chrome trace-event
+//                  JSON
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <sys/syscall.h>
+#include <stdexcept>
+#include "span_trace.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// thread_id() - Returns the kernel's ID for the calling thread.  It's looked up once per thread
+//=================================================================================================
+static uint32_t thread_id()
+{
+    static thread_local uint32_t tid = syscall(SYS_gettid);
+    return tid;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start() - Allocates the buffer and starts recording
+//=================================================================================================
+void SpanTrace::start(size_t capacity)
+{
+    stop();
+
+    // Touch every record now, so recording never takes a page fault
+    rec_.reset(new span_rec_t[capacity]);
+    for (size_t i = 0; i < capacity; ++i) rec_[i].name = nullptr;
+
+    capacity_     = capacity;
+    next_         = 0;
+    dropped_      = 0;
+    thread_count_ = 0;
+    start_ns_     = now_ns();
+    enabled_      = true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop() - Stops recording and frees the buffer
+//=================================================================================================
+void SpanTrace::stop()
+{
+    enabled_  = false;
+    rec_.reset();
+    capacity_ = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// record() - Claims the next record in the buffer and fills it in
+//=================================================================================================
+void SpanTrace::record(const char* name, const char* category, int64_t start_ns, int64_t end_ns,
+                       const char* arg_name, int64_t arg)
+{
+    if (!enabled_) return;
+
+    size_t index = next_.fetch_add(1, memory_order_relaxed);
+    if (index >= capacity_)
+    {
+        dropped_.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    span_rec_t& rec = rec_[index];
+    rec.category = category;
+    rec.arg_name = arg_name;
+    rec.arg      = arg;
+    rec.start_ns = start_ns;
+    rec.end_ns   = end_ns;
+    rec.tid      = thread_id();
+    rec.name.store(name, memory_order_release);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// span() - Records a span that ran from "start_ns" to "end_ns"
+//=================================================================================================
+void SpanTrace::span(const char* name, const char* category, int64_t start_ns, int64_t end_ns,
+                     const char* arg_name, int64_t arg)
+{
+    record(name, category, start_ns, end_ns, arg_name, arg);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// instant() - Records an event that happened right now
+//=================================================================================================
+void SpanTrace::instant(const char* name, const char* category, const char* arg_name, int64_t arg)
+{
+    record(name, category, now_ns(), -1, arg_name, arg);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// name_thread() - Gives the calling thread a name in the trace
+//=================================================================================================
+void SpanTrace::name_thread(const char* name)
+{
+    if (!enabled_) return;
+    size_t index = thread_count_.fetch_add(1);
+    if (index < MAX_THREADS) thread_name_[index] = {thread_id(), name};
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// write() - Writes the spans recorded so far as Chrome trace-event JSON.  Times are in
+//           microseconds from the start of recording
+//
+// Returns: the number of spans written
+//=================================================================================================
+size_t SpanTrace::write(string filename)
+{
+    size_t written = 0;
+
+    FILE* ofile = fopen(filename.c_str(), "w");
+    if (ofile == nullptr) throwRuntime("Can't create %s", filename.c_str());
+
+    fprintf(ofile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(ofile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%i,\"args\":{\"name\":\"bce_feeder\"}}", getpid());
+
+    // Thread names
+    size_t thread_count = min(thread_count_.load(), MAX_THREADS);
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        fprintf
+        (
+            ofile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%i,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            getpid(), thread_name_[i].first, thread_name_[i].second
+        );
+    }
+
+    // Every finished span.  Spans from before recording started (e.g., startup phases noted
+    // early) get negative times, which the viewers handle
+    size_t count = min(next_.load(), capacity_);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const span_rec_t& rec = rec_[i];
+        const char* name = rec.name.load(memory_order_acquire);
+        if (name == nullptr) continue;
+
+        double ts = (rec.start_ns - start_ns_) / 1000.0;
+        fprintf(ofile, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%i,\"tid\":%u,\"ts\":%.3f",
+                name, rec.category, getpid(), rec.tid, ts);
+        if (rec.end_ns < 0)
+            fprintf(ofile, ",\"ph\":\"i\",\"s\":\"t\"");
+        else
+            fprintf(ofile, ",\"ph\":\"X\",\"dur\":%.3f", (rec.end_ns - rec.start_ns) / 1000.0);
+        if (rec.arg_name) fprintf(ofile, ",\"args\":{\"%s\":%li}", rec.arg_name, rec.arg);
+        fprintf(ofile, "}");
+        ++written;
+    }
+
+    fprintf(ofile, "\n]}\n");
+    if (fclose(ofile) != 0) throwRuntime("Failed while writing %s", filename.c_str());
+    return written;
+}
+//=================================================================================================
@@ -0,0 +1,125 @@
+//=================================================================================================
+// span_trace.h - Defines a recorder of timed spans (startup phases, FIFO loads, loader activity,
+//                control events) that is written out as Chrome trace-event JSON
+//
+// Every span goes into a buffer that's allocated when recording starts, so recording never
+// allocates memory or does I/O.  Names, categories and argument names must be string literals
+// (or otherwise outlive the recorder).  The JSON is written by write(), and can be loaded into
+// Perfetto (ui.perfetto.dev) or chrome://tracing
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+class SpanTrace
+{
+public:
+
+    // Constructor
+    SpanTrace() {}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    SpanTrace(const SpanTrace&) = delete;
+    SpanTrace& operator= (const SpanTrace&) = delete;
+
+    // Starts recording, with room for "capacity" spans.  Spans beyond that are dropped
+    void    start(size_t capacity);
+
+    // Stops recording and frees the buffer
+    void    stop();
+
+    // Returns true while we're recording
+    bool    enabled() const {return enabled_;}
+
+    // Returns the current time in nanoseconds (CLOCK_MONOTONIC, the same as steady_clock)
+    static int64_t now_ns()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    // Records a span that ran from "start_ns" to "end_ns" on the calling thread.  If "arg_name"
+    // isn't null, "arg" is shown alongside the span
+    void    span(const char* name, const char* category, int64_t start_ns, int64_t end_ns,
+                 const char* arg_name = nullptr, int64_t arg = 0);
+
+    // Records an event that happened at a single moment on the calling thread
+    void    instant(const char* name, const char* category,
+                    const char* arg_name = nullptr, int64_t arg = 0);
+
+    // Gives the calling thread a name in the trace
+    void    name_thread(const char* name);
+
+    // Writes every span recorded so far to a file of Chrome trace-event JSON.  Returns the
+    // number of spans written.  Throws runtime_error on failure
+    size_t  write(std::string filename);
+
+    // Returns the number of spans that didn't fit in the buffer
+    uint64_t dropped() const {return dropped_;}
+
+protected:
+
+    // A single span.  "name" is stored last, so a span with a null name isn't finished yet.
+    // An instant event has end_ns < 0
+    struct span_rec_t
+    {
+        std::atomic<const char*> name;
+        const char* category;
+        const char* arg_name;
+        int64_t     arg;
+        int64_t     start_ns;
+        int64_t     end_ns;
+        uint32_t    tid;
+    };
+
+    // Claims the next record and fills it in
+    void    record(const char* name, const char* category, int64_t start_ns, int64_t end_ns,
+                   const char* arg_name, int64_t arg);
+
+    // The buffer, and the index of the next unused record
+    std::unique_ptr<span_rec_t[]> rec_;
+    size_t                  capacity_ = 0;
+    std::atomic<size_t>     next_{0};
+    std::atomic<uint64_t>   dropped_{0};
+    std::atomic<bool>       enabled_{false};
+
+    // When recording started; timestamps in the trace are relative to this
+    int64_t                 start_ns_ = 0;
+
+    // The names given to threads
+    static const size_t     MAX_THREADS = 64;
+    std::pair<uint32_t, const char*> thread_name_[MAX_THREADS];
+    std::atomic<size_t>     thread_count_{0};
+};
+
+
+//=================================================================================================
+// TraceScope - Records a span from construction to destruction, if the trace is enabled
+//=================================================================================================
+class TraceScope
+{
+public:
+    TraceScope(SpanTrace& trace, const char* name, const char* category,
+               const char* arg_name = nullptr, int64_t arg = 0)
+    : trace_(trace), name_(name), category_(category), arg_name_(arg_name), arg_(arg),
+      start_ns_(trace.enabled() ? SpanTrace::now_ns() : 0) {}
+
+    ~TraceScope()
+    {
+        if (start_ns_) trace_.span(name_, category_, start_ns_, SpanTrace::now_ns(), arg_name_, arg_);
+    }
+
+protected:
+    SpanTrace&  trace_;
+    const char* name_;
+    const char* category_;
+    const char* arg_name_;
+    int64_t     arg_;
+    int64_t     start_ns_;
+};
+//=================================================================================================